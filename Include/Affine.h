@@ -0,0 +1,78 @@
+// Affine.h - affine transformations as 3x4 matrices, and in decomposed (TRS) form
+
+#ifndef AFFINE_HDR
+#define AFFINE_HDR
+
+#include "Quaternion.h"
+#include "VecMat.h"
+
+// a mat3x4 is the top three rows of a mat4 whose bottom row is (0,0,0,1): rotation,
+// scale, and shear in the left 3x3, translation in the right column; a product takes
+// 36 multiplies (a mat4 product, 64), a point 9, and the inverse needs only a 3x3
+
+// usage:
+//     mat3x4 world = parent.world*node.local.Matrix();
+//     SetUniform(program, "modelview", camera.modelview*world);   // converts to mat4
+//     vec3 p = world*q, d = world.Vector(v), n = NormalMatrix(world)*normal;
+
+class mat3x4 {
+public:
+    vec4 row[3];
+    // constructors
+    constexpr mat3x4(float diag = 1) noexcept : row{vec4(diag, 0, 0, 0), vec4(0, diag, 0, 0), vec4(0, 0, diag, 0)} { }
+    constexpr mat3x4(const vec4 &r0, const vec4 &r1, const vec4 &r2) noexcept : row{r0, r1, r2} { }
+    constexpr mat3x4(const mat3 &m, const vec3 &t = vec3()) noexcept :
+        row{vec4(m.row[0], t.x), vec4(m.row[1], t.y), vec4(m.row[2], t.z)} { }
+    constexpr explicit mat3x4(const mat4 &m) noexcept : row{m.row[0], m.row[1], m.row[2]} { }
+        // the bottom row of m is ignored
+    // access
+    vec4 &operator [] (int i) { return row[i]; }
+    const vec4 &operator [] (int i) const { return row[i]; }
+    operator const float *() const { return static_cast<const float*>(&row[0].x); }
+    operator mat4 () const { return mat4(row[0], row[1], row[2], vec4(0, 0, 0, 1)); }
+    // operations
+    mat3x4 operator * (const mat3x4 &m) const {
+        mat3x4 r;
+        MultiplyRows(*this, m, &r.row[0].x, true);
+        return r;
+    }
+    vec3 operator * (const vec3 &p) const {
+        // transform point p (w = 1)
+        return vec3(dot(row[0], vec4(p)), dot(row[1], vec4(p)), dot(row[2], vec4(p)));
+    }
+    vec3 Vector(const vec3 &v) const {
+        // transform direction v (w = 0): no translation
+        return vec3(dot(row[0], vec4(v, 0)), dot(row[1], vec4(v, 0)), dot(row[2], vec4(v, 0)));
+    }
+    vec3 Translation() const { return vec3(row[0].w, row[1].w, row[2].w); }
+    void SetTranslation(const vec3 &t) { row[0].w = t.x; row[1].w = t.y; row[2].w = t.z; }
+};
+
+static_assert(std::is_trivially_copyable<mat3x4>::value && sizeof(mat3x4) == 12*sizeof(float), "mat3x4 layout");
+
+mat3x4 InverseAffine(const mat3x4 &m, bool *invertible = NULL);
+    // if m is singular, return identity (and set *invertible false)
+
+mat3 NormalMatrix(const mat3x4 &m);
+    // inverse transpose of the left 3x3, for transforming normals (unnormalized if m scales)
+
+mat3x4 RotateXYZ(const vec3 &degrees);
+    // RotateX(degrees.x)*RotateY(degrees.y)*RotateZ(degrees.z), without the products
+
+// a TRS is a translation, rotation (unit quaternion, as Quaternion(axis, radians)), and
+// scale, applied to points in the order scale, rotate, translate; it interpolates
+// better than a matrix and is cheaper to store
+
+class TRS {
+public:
+    vec3 t, s = vec3(1);
+    Quaternion r = Quaternion(0, 0, 0, 1);
+    TRS() { }
+    TRS(const vec3 &t, const Quaternion &r = Quaternion(0, 0, 0, 1), const vec3 &s = vec3(1)) : t(t), s(s), r(r) { }
+    TRS(const mat3x4 &m);
+        // decompose m, assumed to have no shear (scale is positive)
+    mat3x4 Matrix() const;
+        // Translate(t)*rotation*Scale(s)
+};
+
+#endif
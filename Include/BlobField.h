@@ -0,0 +1,64 @@
+// BlobField.h - sum of Wyvill blobs, binned in a uniform grid for fast evaluation
+
+#ifndef BLOB_FIELD_HDR
+#define BLOB_FIELD_HDR
+
+#include <vector>
+#include "VecMat.h"
+
+// the field at p is sum(weight*Wyvill(|p-center|/radius))-threshold, positive inside,
+// where Wyvill is the FilterWyvill kernel (Filter.h), evaluated as a cubic in x^2
+
+// each grid cell stores (as separate coordinate arrays, padded to a multiple of four)
+// every blob whose support overlaps the cell, so an evaluation reads only the cell
+// containing p; cost depends on blob density, not blob count
+
+// usage with the polygonizer (std::cref avoids copying the grid):
+//     BlobField blobs;
+//     blobs.Add(vec3(0, 0, 0), .5f); ...
+//     blobs.Build();
+//     Polygonize(.02f, 100, std::cref(blobs), mesh, std::cref(blobs));
+// seeding evaluates a coarse grid by the batched Evaluate; alternatively, march from the
+// blob centers (no coarse grid, so the scalar Evaluate only):
+//     std::vector<vec3> starts = blobs.Centers();
+//     Polygonize(starts, .02f, 100, std::cref(blobs), mesh, std::cref(blobs));
+
+class BlobField {
+public:
+    BlobField(float threshold = .5f) : threshold(threshold) { }
+    void Add(const vec3 &center, float radius, float weight = 1);
+    void Clear();
+    void Build();
+        // bin blobs into the grid; call after Add and before evaluation
+    int NBlobs() { return (int) blobs.size(); }
+    std::vector<vec3> Centers();
+        // blob centers, usable as Polygonize start points
+    bool Bounds(vec3 &min, vec3 &max) const;
+        // extent of blob supports; false if no blobs
+    float Evaluate(const vec3 &p) const;
+    float Evaluate(const vec3 &p, vec3 &gradient) const;
+        // return field value and set analytic gradient at p
+    void Evaluate(const vec3 *points, float *values, int n) const;
+        // field values for n points; cheapest when successive points are near each other
+    float operator() (const vec3 &p) const { return Evaluate(p); }
+    float operator() (const vec3 &p, vec3 &gradient) const { return Evaluate(p, gradient); }
+        // as Field and Gradient for Polygonize (PolygonizerT.h)
+    float threshold;
+private:
+    struct Blob {
+        vec3 center;
+        float radius, weight;
+    };
+    std::vector<Blob> blobs;
+    // grid
+    vec3 min;
+    float cellSize = 0, invCellSize = 0;
+    int3 res;
+    std::vector<int> cellStart;     // per cell, index into coefficient arrays (res product + 1)
+    std::vector<float> cx, cy, cz, invR2, w;
+    int CellIndex(const vec3 &p) const;
+        // -1 if p outside grid
+    float SumCell(int cell, const vec3 &p) const;
+};
+
+#endif
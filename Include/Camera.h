@@ -13,6 +13,13 @@
 //   drag: translate along X and Y axes
 //   wheel: translate along Z axis
 
+// the version increases whenever modelview or persp changes, so per-frame work that
+// depends on them (uniforms, culling, screen projections) can be skipped if not Changed:
+//     if (camera.Changed(cullVersion)) {
+//         frustum.Set(camera.fullview);
+//         cullVersion = camera.Version();
+//     }
+
 class Camera {
 private:
     float   aspectRatio = 1;
@@ -26,8 +33,18 @@ private:
     vec3    rotateOffset;               // for temp change in world rotation origin
     float   tranSpeed = .01f;
     float   rotSpeed = .3f;
+    unsigned long version = 0;          // incremented when a matrix changes
+    mutable unsigned long cached = 0;   // version of inverse and normal
+    mutable mat4 inverse;
+    mutable mat3 normal;
+    void    SetMatrices(const mat4 &mv, bool perspective = false);
+    void    UpdateCache() const;
 public:
     mat4    modelview, persp, fullview; // read-only
+    unsigned long Version() const { return version; }
+    bool    Changed(unsigned long since) const { return version != since; }
+    const mat4 &GetInverse() const;     // inverse of modelview
+    const mat3 &GetNormal() const;      // inverse transpose of modelview's 3x3, for normals
     mat4    GetRotate();
     void    SetRotateCenter(vec3 r);
     void    MouseUp();
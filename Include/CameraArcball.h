@@ -14,6 +14,8 @@
 //   drag: translate along X and Y axes
 //   wheel: translate along Z axis
 
+// as for Camera, the version increases whenever modelview or persp changes
+
 class CameraAB {
 private:
     float   aspectRatio = 1;
@@ -26,9 +28,19 @@ private:
     float   tranSpeed = .01f; //, rotSpeed;
     mat4    rot;                        // rotations controlled by arcball
     vec3    tran, tranOld;              // translation controlled directly by mouse
+    unsigned long version = 0;          // incremented when a matrix changes
+    mutable unsigned long cached = 0;   // version of inverse and normal
+    mutable mat4 inverse;
+    mutable mat3 normal;
+    void    SetMatrices(const mat4 &mv, bool perspective = false);
+    void    UpdateCache() const;
 public:
     Arcball arcball;
     mat4    modelview, persp, fullview; // read-only
+    unsigned long Version() const { return version; }
+    bool    Changed(unsigned long since) const { return version != since; }
+    const mat4 &GetInverse() const;     // inverse of modelview
+    const mat3 &GetNormal() const;      // inverse transpose of modelview's 3x3, for normals
     mat4    GetRotate();
     void    SetRotateCenter(vec3 r);
     void    MouseUp();
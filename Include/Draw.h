@@ -18,11 +18,12 @@ bool IsVisible(vec3 p, mat4 fullview, vec2 *screen = NULL, int *w = NULL, int *h
 vec2 ScreenPoint(vec3 p, mat4 m, float *zscreen = NULL);
     // transform 3D point to location (xscreen, yscreen), in pixels; if non-null, set zscreen
     // uses current GL viewport
-void ScreenRay(float xscreen, float yscreen, mat4 modelview, mat4 persp, vec3 &p, vec3 &v);
-void ScreenLine(float xscreen, float yscreen, mat4 modelview, mat4 persp, vec3 &p1, vec3 &p2);
+void ScreenRay(float xscreen, float yscreen, mat4 modelview, mat4 persp, vec3 &p, vec3 &v, const int *viewport = NULL);
+void ScreenLine(float xscreen, float yscreen, mat4 modelview, mat4 persp, vec3 &p1, vec3 &p2, const int *viewport = NULL);
     // compute 3D world space line, given by p1 and p2, that transforms
     // to a line perpendicular to the screen at pixel (xscreen, yscreen)
-    // uses current viewport
+    // the inverse of persp*modelview is cached until either changes; if viewport (x, y,
+    // width, height) is null, the GL viewport is queried
 float ScreenDistSq(int x, int y, vec3 p, mat4 m, float *zscreen = NULL);
 float ScreenDistSq(double x, double y, vec3 p, mat4 m, float *zscreen = NULL);
     // return distance squared, in pixels, between screen point (x, y) and point p xformed by view matrix
@@ -0,0 +1,54 @@
+// Frustum.h - view frustum planes, and culling of bounding spheres and boxes
+
+#ifndef FRUSTUM_HDR
+#define FRUSTUM_HDR
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "Vec3Array.h"
+#include "VecMat.h"
+
+// planes are extracted from a full view (persp*modelview, as Camera::fullview), so volumes
+// are tested in the space that matrix transforms from (world, or model); a volume is culled
+// only if wholly outside some plane, so a few volumes near the frustum edges are kept
+// although not visible
+
+// usage:
+//     Frustum frustum(camera.fullview);
+//     CullStats stats;                                         // optional, reset per frame
+//     CullSpheres(frustum, centers, radii, visible, &stats);   // indices of spheres to draw
+
+struct CullStats {
+    // optionally filled by the Cull functions; counts accumulate until Reset
+    long long spheresTested = 0, boxesTested = 0, visible = 0;
+    double time = 0;                    // seconds
+    void Reset() { *this = CullStats(); }
+    long long Culled() const { return spheresTested+boxesTested-visible; }
+};
+
+class Frustum {
+public:
+    vec4 planes[6];
+        // left, right, bottom, top, near, far: (a, b, c, d) with a*x+b*y+c*z+d >= 0 inside
+        // and (a, b, c) unit length
+    Frustum() { }
+    Frustum(const mat4 &fullview) { Set(fullview); }
+    void Set(const mat4 &fullview);
+    bool SphereVisible(const vec3 &center, float radius) const;
+    bool BoxVisible(const vec3 &min, const vec3 &max) const;
+};
+
+// bulk tests; mask holds (Size+31)/32 words, bit i%32 of mask[i/32] set if volume i
+// is visible; visible is set to the indices of visible volumes, in increasing order;
+// each returns the number visible
+
+size_t CullSpheres(const Frustum &f, const Vec3Array &centers, const float *radii, uint32_t *mask, CullStats *stats = NULL);
+size_t CullSpheres(const Frustum &f, const Vec3Array &centers, const float *radii, std::vector<int> &visible, CullStats *stats = NULL);
+    // radii holds centers.Size() floats
+
+size_t CullBoxes(const Frustum &f, const Vec3Array &mins, const Vec3Array &maxs, uint32_t *mask, CullStats *stats = NULL);
+size_t CullBoxes(const Frustum &f, const Vec3Array &mins, const Vec3Array &maxs, std::vector<int> &visible, CullStats *stats = NULL);
+    // axis-aligned boxes, mins and maxs of the same Size
+
+#endif
@@ -0,0 +1,51 @@
+// ImplicitExpr.h - implicit functions from formulas, compiled to register bytecode
+
+#ifndef IMPLICIT_EXPR_HDR
+#define IMPLICIT_EXPR_HDR
+
+#include <string>
+#include <vector>
+#include "Interval.h"
+#include "VecMat.h"
+
+// a formula in x, y and z, positive inside, for example:
+//     "smax(1-length(x, y, z), .4-length(length(x, y)-.8, z), .1)"
+//     "min(1.2-length(x, y, z), .3-abs(sin(6*x)*cos(6*y)+sin(6*y)*cos(6*z)+sin(6*z)*cos(6*x)))"
+// operators: + - * / ^ (power, right-associative), unary -, parentheses
+// constants: pi
+// functions: sin cos abs sqrt exp log pow min max (two or more arguments), length (two or
+//            three), clamp(v, lo, hi), smin(a, b, k) and smax(a, b, k) (polynomial blend of
+//            width k; smax is a smooth union for positive-inside functions)
+
+// the formula is parsed into a graph in which identical subexpressions are shared and
+// constant subexpressions are folded, then compiled to instructions over registers;
+// batched evaluation runs each instruction over a block of points, so the interpreter
+// cost is amortized and the per-instruction loops vectorize
+
+class ImplicitExpr {
+public:
+    bool Compile(const char *formula);
+        // return false if formula can't be parsed (see Error)
+    const char *Error() { return error.c_str(); }
+    float Evaluate(const vec3 &p) const;
+    void Evaluate(const vec3 *points, float *values, int n) const;
+        // field values for n points (0 if not successfully compiled)
+    Interval Bound(const vec3 &min, const vec3 &max) const;
+        // range of values within box min-max (see Interval.h)
+    float operator() (const vec3 &p) const { return Evaluate(p); }
+        // as Field for Polygonize (PolygonizerT.h); use std::cref to avoid copying
+    int NInstructions() { return (int) code.size(); }
+    int NRegisters() { return nRegisters; }
+private:
+    struct Instruction {
+        unsigned char op;
+        unsigned short dst, a, b, c;
+    };
+    std::vector<Instruction> code;
+    std::vector<float> constants;       // preloaded into registers 3, 4, ...
+    int nRegisters = 0, result = 0;
+    std::string error;
+    template <int LANES> void Run(float *regs) const;
+};
+
+#endif
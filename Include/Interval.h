@@ -0,0 +1,145 @@
+// Interval.h - interval arithmetic, and implicit primitives bounded over boxes
+
+#ifndef INTERVAL_HDR
+#define INTERVAL_HDR
+
+#include <math.h>
+#include "VecMat.h"
+
+// Interval Arithmetic
+
+// an Interval bounds every value an expression takes as its arguments range over their
+// intervals; results are conservative (they may be wider than the true range)
+
+struct Interval {
+    float lo, hi;
+    Interval(float v = 0) : lo(v), hi(v) { }
+    Interval(float lo, float hi) : lo(lo), hi(hi) { }
+    bool Contains(float v) const { return lo <= v && v <= hi; }
+    Interval operator - () const { return Interval(-hi, -lo); }
+    Interval operator + (const Interval &i) const { return Interval(lo+i.lo, hi+i.hi); }
+    Interval operator - (const Interval &i) const { return Interval(lo-i.hi, hi-i.lo); }
+    Interval operator * (const Interval &i) const {
+        float a = lo*i.lo, b = lo*i.hi, c = hi*i.lo, d = hi*i.hi;
+        return Interval(fminf(fminf(a, b), fminf(c, d)), fmaxf(fmaxf(a, b), fmaxf(c, d)));
+    }
+    Interval operator * (float s) const { return s < 0? Interval(s*hi, s*lo) : Interval(s*lo, s*hi); }
+    friend Interval operator * (float s, const Interval &i) { return i*s; }
+};
+
+inline Interval Min(const Interval &a, const Interval &b) { return Interval(fminf(a.lo, b.lo), fminf(a.hi, b.hi)); }
+inline Interval Max(const Interval &a, const Interval &b) { return Interval(fmaxf(a.lo, b.lo), fmaxf(a.hi, b.hi)); }
+
+inline Interval Abs(const Interval &i) {
+    if (i.lo >= 0) return i;
+    if (i.hi <= 0) return -i;
+    return Interval(0, fmaxf(-i.lo, i.hi));
+}
+
+inline Interval Sqr(const Interval &i) {
+    // tighter than i*i, which cannot know both factors are the same
+    Interval a = Abs(i);
+    return Interval(a.lo*a.lo, a.hi*a.hi);
+}
+
+inline Interval Sqrt(const Interval &i) {
+    return Interval(sqrtf(fmaxf(i.lo, 0)), sqrtf(fmaxf(i.hi, 0)));
+}
+
+inline Interval Length(const Interval &x, const Interval &y) { return Sqrt(Sqr(x)+Sqr(y)); }
+inline Interval Length(const Interval &x, const Interval &y, const Interval &z) { return Sqrt(Sqr(x)+Sqr(y)+Sqr(z)); }
+
+// Primitives
+
+// each is a field (positive inside, approximately the distance to the surface) callable
+// at a point, with Bound(min, max) returning an Interval over the box min-max; Polygonize
+// (PolygonizerT.h) uses Bound, if present, to skip space that cannot contain the surface
+
+struct SphereField {
+    vec3 center;
+    float radius;
+    SphereField(const vec3 &c = vec3(0, 0, 0), float r = 1) : center(c), radius(r) { }
+    float operator() (const vec3 &p) const { return radius-length(p-center); }
+    Interval Bound(const vec3 &min, const vec3 &max) const {
+        Interval x(min.x-center.x, max.x-center.x), y(min.y-center.y, max.y-center.y), z(min.z-center.z, max.z-center.z);
+        return Interval(radius)-Length(x, y, z);
+    }
+};
+
+struct BoxField {
+    vec3 center, halfSize;
+    BoxField(const vec3 &c = vec3(0, 0, 0), const vec3 &h = vec3(1, 1, 1)) : center(c), halfSize(h) { }
+    float operator() (const vec3 &p) const {
+        // negated signed distance
+        float qx = fabsf(p.x-center.x)-halfSize.x, qy = fabsf(p.y-center.y)-halfSize.y, qz = fabsf(p.z-center.z)-halfSize.z;
+        float outside = sqrtf(fmaxf(qx, 0)*fmaxf(qx, 0)+fmaxf(qy, 0)*fmaxf(qy, 0)+fmaxf(qz, 0)*fmaxf(qz, 0));
+        return -outside-fminf(fmaxf(qx, fmaxf(qy, qz)), 0);
+    }
+    Interval Bound(const vec3 &min, const vec3 &max) const {
+        Interval qx = Abs(Interval(min.x-center.x, max.x-center.x))-halfSize.x;
+        Interval qy = Abs(Interval(min.y-center.y, max.y-center.y))-halfSize.y;
+        Interval qz = Abs(Interval(min.z-center.z, max.z-center.z))-halfSize.z;
+        Interval outside = Length(Max(qx, 0), Max(qy, 0), Max(qz, 0));
+        return -outside-Min(Max(qx, Max(qy, qz)), 0);
+    }
+};
+
+struct PlaneField {
+    vec3 normal;                // unit length, points outward
+    float offset;               // inside where dot(normal, p) < offset
+    PlaneField(const vec3 &n = vec3(0, 0, 1), float o = 0) : normal(n), offset(o) { }
+    float operator() (const vec3 &p) const { return offset-dot(normal, p); }
+    Interval Bound(const vec3 &min, const vec3 &max) const {
+        Interval d = Interval(normal.x)*Interval(min.x, max.x)+Interval(normal.y)*Interval(min.y, max.y)+Interval(normal.z)*Interval(min.z, max.z);
+        return Interval(offset)-d;
+    }
+};
+
+struct TorusField {
+    vec3 center;                // axis is z
+    float major, minor;
+    TorusField(const vec3 &c = vec3(0, 0, 0), float R = 1, float r = .25f) : center(c), major(R), minor(r) { }
+    float operator() (const vec3 &p) const {
+        float dx = p.x-center.x, dy = p.y-center.y, dz = p.z-center.z;
+        float q = sqrtf(dx*dx+dy*dy)-major;
+        return minor-sqrtf(q*q+dz*dz);
+    }
+    Interval Bound(const vec3 &min, const vec3 &max) const {
+        Interval dx(min.x-center.x, max.x-center.x), dy(min.y-center.y, max.y-center.y), dz(min.z-center.z, max.z-center.z);
+        Interval q = Length(dx, dy)-major;
+        return Interval(minor)-Length(q, dz);
+    }
+};
+
+// CSG
+
+template <class A, class B>
+struct UnionField {
+    A a;
+    B b;
+    float operator() (const vec3 &p) const { return fmaxf(a(p), b(p)); }
+    Interval Bound(const vec3 &min, const vec3 &max) const { return Max(a.Bound(min, max), b.Bound(min, max)); }
+};
+
+template <class A, class B>
+struct IntersectField {
+    A a;
+    B b;
+    float operator() (const vec3 &p) const { return fminf(a(p), b(p)); }
+    Interval Bound(const vec3 &min, const vec3 &max) const { return Min(a.Bound(min, max), b.Bound(min, max)); }
+};
+
+template <class A, class B>
+struct DifferenceField {
+    A a;
+    B b;
+    float operator() (const vec3 &p) const { return fminf(a(p), -b(p)); }
+    Interval Bound(const vec3 &min, const vec3 &max) const { return Min(a.Bound(min, max), -b.Bound(min, max)); }
+};
+
+template <class A, class B> UnionField<A, B> Union(const A &a, const B &b) { UnionField<A, B> f = {a, b}; return f; }
+template <class A, class B> IntersectField<A, B> Intersect(const A &a, const B &b) { IntersectField<A, B> f = {a, b}; return f; }
+template <class A, class B> DifferenceField<A, B> Subtract(const A &a, const B &b) { DifferenceField<A, B> f = {a, b}; return f; }
+    // for example, Subtract(Union(SphereField(c1, r1), SphereField(c2, r2)), BoxField(c3, h3))
+
+#endif
@@ -4,6 +4,9 @@
 #define POLYGONIZER_H
 
 #include "VecMat.h"
+#include "Interval.h"
+#include "PolygonizerT.h"
+#include <stdio.h>
 #include <vector>
 
 typedef float (*ImplicitProc)(const vec3 &p);
@@ -14,19 +17,146 @@ typedef int (*VertexProc)(const vec3 &p, const vec3 &n);
 typedef bool (*TriangleProc)(int i1, int i2, int i3);
     // return false to abort
 
-void Polygonize(vec3              &start,
+typedef float (*GradientProc)(const vec3 &p, vec3 &gradient);
+    // return function value at p and set gradient at p (optional)
+    // if null, vertex normals are interpolated from lattice central differences
+
+typedef Interval (*IntervalProc)(const vec3 &min, const vec3 &max);
+    // return range of function values within box min-max (optional, see Interval.h)
+
+bool Polygonize(vec3              &start,
+                float              cellSize,
+                int                bounds,
+                ImplicitProc       impFunc,
+                VertexProc         vProc,
+                TriangleProc       tProc,
+                GradientProc       gProc = NULL,
+                PolygonizeStats   *stats = NULL);
+    // return false if vProc or tProc aborts
+
+bool Polygonize(std::vector<vec3> &starts,
                 float              cellSize,
                 int                bounds,
                 ImplicitProc       impFunc,
                 VertexProc         vProc,
-                TriangleProc       tProc);
+                TriangleProc       tProc,
+                GradientProc       gProc = NULL,
+                PolygonizeStats   *stats = NULL);
 
-void Polygonize(std::vector<vec3> &starts,
+bool Polygonize(std::vector<vec3> &starts,
                 float              cellSize,
+                int                bounds,
+                ImplicitProc       impFunc,
+                PolyMesh          &mesh,
+                GradientProc       gProc = NULL,
+                int                nTrianglesHint = 0,
+                PolygonizeStats   *stats = NULL);
+    // append vertices and triangles directly to mesh
+    // if non-zero, nTrianglesHint reserves space up front
+    // if non-null, stats (PolygonizerT.h) accumulates evaluation counts, cache hit rates,
+    // hash chain lengths, stack depth, memory, and time; the overhead is a few percent
+
+bool Polygonize(float              cellSize,
                 int                bounds,
                 ImplicitProc       impFunc,
                 VertexProc         vProc,
-                TriangleProc       tProc
-                );
+                TriangleProc       tProc,
+                GradientProc       gProc = NULL,
+                int                coarse = 8,
+                PolygonizeStats   *stats = NULL);
+
+bool Polygonize(float              cellSize,
+                int                bounds,
+                ImplicitProc       impFunc,
+                PolyMesh          &mesh,
+                GradientProc       gProc = NULL,
+                int                coarse = 8,
+                PolygonizeStats   *stats = NULL);
+    // without start points: all surface components within bounds are found by a coarse
+    // grid search (FindSeeds, in PolygonizerT.h) that evaluates every coarse'th lattice
+    // corner concurrently (so impFunc must be thread-safe); output is deterministic
+
+void Merge(std::vector<PolyMesh> &parts, PolyMesh &result);
+    // append parts (such as per-thread output buffers) to result, offsetting vertex ids
+    // space for the total is reserved once
+
+// Mesh Cleanup
+
+struct CleanupStats {
+    int verticesBefore = 0, verticesAfter = 0;
+    int trianglesBefore = 0, trianglesAfter = 0;
+    int snapped = 0;                // vertices moved to a lattice corner
+    int collapsed = 0;              // short edges collapsed
+    void Print(FILE *out = stdout) const;
+};
+
+CleanupStats Cleanup(PolyMesh &mesh, float cellSize, float tolerance = .1f);
+    // remove the slivers DoTet makes where the surface passes near a lattice corner:
+    // vertices within tolerance*cellSize of a corner (of the lattice Polygonize uses, at
+    // multiples of cellSize) move to the corner, then edges shorter than tolerance*cellSize
+    // (such as those between vertices at the same corner) are collapsed, unless that would
+    // make the mesh non-manifold or flip a triangle; normals of merged vertices are
+    // averaged, and arrays are compacted; linear time
+
+// Streaming Output
+
+struct StreamWriter {
+    // sink that writes vertices and triangles to a binary PLY or STL file as they arrive;
+    // for STL, only vertices from the current and previous slab are kept in memory
+    int nVertices = 0, nTriangles = 0;
+    bool Open(const char *filename);
+        // STL if filename ends in .stl, else PLY; return false if can't open
+    int Vertex(const vec3 &p, const vec3 &n);
+    bool Triangle(int i1, int i2, int i3);
+    void EndSlab();
+    bool Close();
+        // complete the header; return false on write error
+    ~StreamWriter() { Close(); }
+private:
+    FILE *file = NULL, *faces = NULL;   // PLY faces go to a temporary file, appended on Close
+    bool stl = false, ok = true;
+    std::vector<vec3> points;           // STL: vertices base, base+1, ...
+    int base = 0, slabStart = 0;
+};
+
+bool PolygonizeToFile(const char         *filename,
+                      float               cellSize,
+                      int                 bounds,
+                      ImplicitProc        impFunc,
+                      GradientProc        gProc = NULL,
+                      int                 slabDepth = 32,
+                      int                 coarse = 8,
+                      PolygonizeStats    *stats = NULL);
+    // stream all surface components within bounds to a PLY or STL file, one slab of
+    // slabDepth lattice layers at a time (PolygonizeSlabs, in PolygonizerT.h); memory is
+    // bounded by the slab size; impFunc must be thread-safe; return false if file error
+
+// Adaptive Polygonization
+
+struct AdaptiveOptions {
+    float errorTolerance = 1e-6f;   // merge eight cells if their combined QEF error is less
+    float lipschitz = 0;            // if non-zero, bound on |gradient|, used to skip empty space
+    int   sampleCells = 4;          // else, nodes this size or smaller with same-signed corners are empty
+    int   nThreads = 0;             // 0: one per hardware thread
+    IntervalProc bound = NULL;      // if non-null, skip nodes whose range excludes zero
+};
+
+void PolygonizeAdaptive(float              cellSize,
+                        int                bounds,
+                        ImplicitProc       impFunc,
+                        PolyMesh          &mesh,
+                        GradientProc       gProc = NULL,
+                        AdaptiveOptions    options = AdaptiveOptions());
+    // dual contouring of an octree whose finest cells are of size cellSize and that covers
+    // the lattice cubes +/-bounds; flat regions are covered by larger cells, chosen by the
+    // quadric error of their edge intersections; output is crack-free
+    // subtrees are built concurrently, so impFunc and gProc must be thread-safe
+
+// template versions (PolygonizerT.h) accept functors and lambdas, for example:
+//     vector<vec3> points, normals;
+//     vector<int3> triangles;
+//     auto sink = MakeSink([&](const vec3 &p, const vec3 &n) { points.push_back(p); normals.push_back(n); return (int) points.size()-1; },
+//                          [&](int i1, int i2, int i3) { triangles.push_back(int3(i1, i2, i3)); return true; });
+//     Polygonize(starts, .05f, 100, [](const vec3 &p) { return 1-dot(p, p); }, sink);
 
 #endif
@@ -0,0 +1,57 @@
+// PolygonizerGPU.h - marching tetrahedra in compute shaders, for implicits written in GLSL
+
+#ifndef POLYGONIZER_GPU_HDR
+#define POLYGONIZER_GPU_HDR
+
+#include <glad.h>
+#include <vector>
+#include "PolygonizerT.h"
+#include "VecMat.h"
+
+// the whole brick is polygonized, rather than continued from seeds, in four passes:
+//     sample:  field values at every lattice point
+//     count:   per lattice point, vertices on the seven lattice edges it owns, and
+//              triangles in the cell whose LBN corner it is
+//     scan:    exclusive prefix sum of both counts, giving each point its output offsets
+//     emit:    vertices (converged, with gradient normals) and triangles, written
+//              directly into the vertex and index buffers
+// cells are split into the same six tetrahedra as Process::DoCube (PolygonizerT.h), with
+// the same triangle orientation; each vertex is shared by every triangle that uses it
+
+// usage (requires a current GL 4.3 context):
+//     PolygonizerGPU gpu;
+//     gpu.Init("float field(vec3 p) { return 1-length(p); }");
+//     gpu.Polygonize(vec3(-1.1f, -1.1f, -1.1f), .01f, int3(220, 220, 220));
+//     gpu.Draw(shaderProgram);            // or gpu.Read(mesh) for a CPU copy
+
+class PolygonizerGPU {
+public:
+    ~PolygonizerGPU() { Release(); }
+    bool Init(const char *fieldCode);
+        // fieldCode is GLSL defining float field(vec3 p), positive inside
+        // return false if shaders do not compile
+    bool Polygonize(const vec3 &min, float cellSize, const int3 &res, int converge = 4);
+        // polygonize res cells along each axis, LBN corner at min; vertices are refined
+        // by converge steps of false position
+        // return false if not initialized or brick has more than 2^26 lattice points
+    int NVertices() { return nVertices; }
+    int NTriangles() { return nTriangles; }
+    GLuint VertexBuffer() { return vBuffer; }
+        // per vertex, vec4 position (w = 1) followed by vec4 normal (w = 0): stride 32 bytes
+    GLuint IndexBuffer() { return iBuffer; }
+        // three unsigned ints per triangle
+    void Draw(GLuint program, const char *pointName = "point", const char *normalName = "normal");
+        // draw triangles with program, whose vertex shader inputs are vec3 point and normal
+    bool Read(PolyMesh &mesh);
+        // copy vertices and triangles to mesh; return false if nothing polygonized
+    void Release();
+        // free programs and buffers (requires current context)
+private:
+    GLuint sampleProgram = 0, countProgram = 0, scanProgram = 0, addProgram = 0, emitProgram = 0;
+    GLuint values = 0, counts = 0, vBuffer = 0, iBuffer = 0, vao = 0;
+    std::vector<GLuint> sums;               // per level of scan, block sums
+    int nPoints = 0, nVertices = 0, nTriangles = 0, vCapacity = 0, iCapacity = 0;
+    void Scan(GLuint data, int n, int level);
+};
+
+#endif
@@ -0,0 +1,1466 @@
+// PolygonizerT.h (c) Jules Bloomenthal, 2014-18
+// template implementation of the polygonizer: the implicit function, the vertex and
+// triangle output, and the optional gradient are compile-time parameters, so cheap
+// functions and callbacks are inlined into SetCorner, Converge and DoTet
+
+#ifndef POLYGONIZER_T_H
+#define POLYGONIZER_T_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <limits.h>
+#include <math.h>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "VecMat.h"
+
+// Field: callable as float(const vec3 &p), positive inside
+// Sink: provides int Vertex(const vec3 &p, const vec3 &n) (return -1 to abort)
+//       and bool Triangle(int i1, int i2, int i3) (return false to abort)
+// Gradient (optional): callable as float(const vec3 &p, vec3 &gradient)
+
+// Statistics
+
+struct PolygonizeStats {
+    // optionally filled by Polygonize; counters are only updated when a stats pointer is given
+    // implicit evaluations, by caller
+    long long setCornerEvals = 0;   // lattice corner values (including those for lattice gradients)
+    long long convergeEvals = 0;    // binary search for surface vertices
+    long long normalEvals = 0;      // central differences, or calls to the analytic gradient
+    long long findEvals = 0;        // search for inside/outside points at seeds (or coarse grid)
+    long long intervalEvals = 0;    // Field::Bound, if provided, to skip empty coarse cells
+    // caches
+    long long cornerLookups = 0, cornerHits = 0;
+    long long sharedCornerHits = 0;             // corner values from another level (PolygonizeLevels)
+    long long edgeLookups = 0, edgeHits = 0;
+    // hash chain length histograms (at end of run): bin 0 counts empty chains,
+    // bin n>0 counts chains of length [2^(n-1), 2^n), and the last bin all longer chains
+    enum {NCHAINS = 12};
+    int cornerChains[NCHAINS] = {}, edgeChains[NCHAINS] = {}, centerChains[NCHAINS] = {};
+    // memory
+    int stackDepth = 0, peakStackDepth = 0;     // cube stack
+    size_t bytesAllocated = 0;                  // total for tables, corners, edges, cubes
+    // wall time, in seconds
+    double seedTime = 0, marchTime = 0, freeTime = 0;
+    long long Evaluations() const { return setCornerEvals+convergeEvals+normalEvals+findEvals; }
+    float CornerHitRate() const { return cornerLookups? (float) cornerHits/cornerLookups : 0; }
+    float EdgeHitRate() const { return edgeLookups? (float) edgeHits/edgeLookups : 0; }
+    static int ChainBin(int length) {
+        int bin = 0;
+        for (; length > 0 && bin < NCHAINS-1; length >>= 1)
+            bin++;
+        return bin;
+    }
+    void Print(FILE *out = stdout) const {
+        fprintf(out, "evaluations: %lld (corner %lld, converge %lld, normal %lld, find %lld)\n",
+            Evaluations(), setCornerEvals, convergeEvals, normalEvals, findEvals);
+        if (intervalEvals)
+            fprintf(out, "interval evaluations: %lld\n", intervalEvals);
+        fprintf(out, "hit rate: corner %.3f, edge %.3f\n", CornerHitRate(), EdgeHitRate());
+        if (sharedCornerHits)
+            fprintf(out, "corner values shared from other levels: %lld\n", sharedCornerHits);
+        const char *names[] = {"corner", "edge", "center"};
+        const int *chains[] = {cornerChains, edgeChains, centerChains};
+        for (int t = 0; t < 3; t++) {
+            fprintf(out, "%s chains:", names[t]);
+            for (int n = 0; n < NCHAINS; n++)
+                if (chains[t][n])
+                    fprintf(out, " %d%s:%d", n? 1<<(n-1) : 0, n == NCHAINS-1? "+" : "", chains[t][n]);
+            fprintf(out, "\n");
+        }
+        fprintf(out, "peak stack %d, %.1f KB allocated\n", peakStackDepth, (float) bytesAllocated/1024.f);
+        fprintf(out, "time: seed %.4f, march %.4f, free %.4f secs\n", seedTime, marchTime, freeTime);
+    }
+};
+
+namespace PolygonizerDetail {
+
+
+const int RES = 9;              // # converge iterations
+enum {L=0, R, B, T, N, F};      // left, right, bottom, top, near, far
+enum {LBN=0, LBF, LTN, LTF, RBN, RBF, RTN, RTF};
+
+// the LBN corner of cube (i, j, k), corresponds with location (i*size, j*size, k*size)
+// *** no longer: (start.x+(i-.5)*size, start.y+(j-.5)*size, start.z+(k-.5)*size)
+
+const int HASHBIT = 5;
+const int HASHSIZE = ((size_t)(1<<(3*HASHBIT)));
+const int MASK = ((1<<HASHBIT)-1);
+
+inline int HASH( int i, int j,int k) {
+    return (((( (i&MASK) << HASHBIT) | (j&MASK)) << HASHBIT) | (k&MASK));
+}
+
+inline int BIT(int i, int bit) {
+    return (i>>bit)&1;
+}
+
+inline long long LatticeKey(int i, int j, int k) {
+    // unique key for lattice location (i, j, k), each within +/- 2^20
+    return ((long long) (i+(1<<20)) << 42) | ((long long) (j+(1<<20)) << 21) | (long long) (k+(1<<20));
+}
+
+inline float RAND() {
+    return (rand()&32767)/32767.0f;
+}
+
+inline int FLIP(int i, int bit) {
+    return i^1<<bit;
+}
+
+struct TEST {                   // test the function for a signed value
+    vec3 p;                     // location of test
+    float value;                // function value at p
+    int ok;                     // if value is of correct sign
+};
+
+struct CORNER {                 // corner of a cube
+    int i, j, k;                // (i, j, k) is index within lattice
+    float x, y, z, value;       // location and function value
+};
+
+struct CUBE {                   // partitioning cell (cube)
+    int i, j, k;                // lattice location of cube
+    float values[8];
+    bool transects;
+};
+
+typedef struct cubes {
+    // linked list of cubes acting as stack
+    CUBE cube;                  // a single cube
+    struct cubes *next;         // remaining elements
+} CUBES;
+
+typedef struct centerlist {
+    // list of cube locations
+    int i, j, k;                // cube location
+    struct centerlist *next;    // remaining elements
+} CENTERLIST;
+
+typedef struct cornerlist {
+    // list of corners
+    int i, j, k;                // corner id
+    float value;                // corner value
+    bool hasGradient;           // gradient set (on demand, by CornerGradient)
+    vec3 gradient;              // lattice central difference
+    struct cornerlist *next;    // remaining elements
+} CORNERLIST;
+
+typedef struct edgelist {
+    // list of edges
+    unsigned int i1, j1, k1, i2, j2, k2; // edge corner ids
+    int vid;                    // vertex id
+    struct edgelist *next;      // remaining elements
+} EDGELIST;
+
+// mycalloc used for CUBES *cubes, CENTERLIST **centers, CORNERLIST **corners, EDGELIST **edges
+// FreeAll frees edges, corners, centers (cubes deallocated during March()
+
+inline char *mycalloc (int nitems, int nbytes) {
+    char *ptr = (char *) calloc(nitems, nbytes);
+    if (ptr == NULL)
+        throw("can't allocate memory");
+    return ptr;
+}
+
+// gradient presence: a Gradient type may overload Enabled (found by argument-dependent
+// lookup) to decide at run time; NoGradient is compile-time false, so its branch is dropped
+
+struct NoGradient {
+    float operator() (const vec3 &, vec3 &g) const { g = vec3(0, 0, 0); return 0; }
+};
+
+template <class Gradient> inline bool Enabled(const Gradient &) { return true; }
+inline bool Enabled(const NoGradient &) { return false; }
+
+// valid only for a callable Gradient, so a NULL argument selects the C interface overload
+
+template <class Gradient>
+using GradientCall = decltype(std::declval<Gradient &>()(std::declval<const vec3 &>(), std::declval<vec3 &>()));
+
+// optional sink hook: called with the lattice location of each cube before it is polygonized
+
+template <class Sink> inline auto BeginCube(Sink &s, int i, int j, int k, int) -> decltype(s.BeginCube(i, j, k), void()) {
+    s.BeginCube(i, j, k);
+}
+template <class Sink> inline void BeginCube(Sink &, int, int, int, long) { }
+
+// optional sink hook: called after each slab of a streaming polygonization
+
+template <class Sink> inline auto EndSlab(Sink &s, int) -> decltype(s.EndSlab(), void()) {
+    s.EndSlab();
+}
+template <class Sink> inline void EndSlab(Sink &, long) { }
+
+// a field passed as std::cref(f) (to avoid copying it) is tested for the optional members
+// below, Bound and batched Evaluate, through f itself
+
+template <class T> struct Unwrapped { typedef T type; };
+template <class T> struct Unwrapped<std::reference_wrapper<T> > { typedef T type; };
+
+template <class T> inline T &Unwrap(T &f) { return f; }
+template <class T> inline T &Unwrap(std::reference_wrapper<T> &f) { return f.get(); }
+template <class T> inline T &Unwrap(const std::reference_wrapper<T> &f) { return f.get(); }
+
+// optional field bound: Interval Bound(const vec3 &min, const vec3 &max) const (see Interval.h)
+// returns a range containing every field value within the box; if provided, space that
+// cannot contain the surface (the range excludes zero) is skipped during seeding
+
+template <class Field, class = void> struct HasBound : std::false_type { };
+template <class Field> struct HasBound<Field, decltype(void(std::declval<const Field &>().Bound(vec3(), vec3())))> : std::true_type { };
+
+template <class Field> inline auto MayContainSurface(const Field &f, const vec3 &min, const vec3 &max, int)
+        -> decltype(f.Bound(min, max), bool()) {
+    auto b = f.Bound(min, max);
+    return b.lo <= 0 && b.hi > 0;
+}
+template <class Field> inline bool MayContainSurface(const Field &, const vec3 &, const vec3 &, long) { return true; }
+
+// optional batched evaluation: void Evaluate(const vec3 *points, float *values, int n) const
+// (as provided by BlobField and ImplicitExpr) is used for rows of the coarse grid
+
+template <class Field, class = void> struct HasEvaluateBatch : std::false_type { };
+template <class Field> struct HasEvaluateBatch<Field, decltype(void(Unwrap(std::declval<Field &>()).Evaluate((const vec3 *) NULL, (float *) NULL, 0)))> : std::true_type { };
+    // true if EvaluateBatch(Unwrap(field), ...) uses the field's batched Evaluate
+
+template <class Field> inline auto EvaluateBatch(Field &f, const vec3 *points, float *values, int n, int)
+        -> decltype(f.Evaluate(points, values, n), void()) {
+    f.Evaluate(points, values, n);
+}
+template <class Field> inline void EvaluateBatch(Field &f, const vec3 *points, float *values, int n, long) {
+    for (int i = 0; i < n; i++)
+        values[i] = f(points[i]);
+}
+
+// corner values shared by Processes polygonizing the same field at different resolutions,
+// keyed by location on the finest lattice; striped locks, as levels run concurrently
+
+class SharedCorners {
+public:
+    bool Get(int i, int j, int k, float &value) {
+        Stripe &s = stripes[HASH(i, j, k)&(NSTRIPES-1)];
+        std::lock_guard<std::mutex> lock(s.mutex);
+        std::unordered_map<long long, float>::iterator it = s.values.find(LatticeKey(i, j, k));
+        if (it == s.values.end())
+            return false;
+        value = it->second;
+        return true;
+    }
+    void Set(int i, int j, int k, float value) {
+        Stripe &s = stripes[HASH(i, j, k)&(NSTRIPES-1)];
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.values[LatticeKey(i, j, k)] = value;
+    }
+private:
+    enum {NSTRIPES = 64};
+    struct Stripe {
+        std::mutex mutex;
+        std::unordered_map<long long, float> values;
+    };
+    Stripe stripes[NSTRIPES];
+};
+
+template <class Field, class Sink, class Gradient>
+class Process {
+public:
+    // parameters, function, storage
+    Field         field;        // implicit function
+    Sink         &sink;         // vertex and triangle output
+    Gradient      gradient;     // optional analytic gradient
+    float         size;         // cube size
+    float         delta;        // normal delta (if no lattice gradient)
+    int           bounds;       // cube range within lattice
+    CUBES        *cubes;        // active cubes
+    CENTERLIST  **centers;      // cube center hash table (prevent cycling)
+    CORNERLIST  **corners;      // corner value hash table
+    EDGELIST    **edges;        // edge and vertex id hash table
+    PolygonizeStats *stats;     // optional instrumentation
+    int           kMin, kMax;   // cube range in z (for slab streaming)
+    CUBES        *deferred;     // cubes above kMax, for next slab
+    SharedCorners *shared;      // values shared with other levels (for PolygonizeLevels)
+    int           sharedScale;  // lattice index multiplier to shared (finest) lattice
+    int           sharedMask;   // share corners whose indices have none of these bits set
+
+    char *Alloc(int nitems, int nbytes) {
+        if (stats)
+            stats->bytesAllocated += (size_t) nitems*nbytes;
+        return mycalloc(nitems, nbytes);
+    }
+
+    void Push(CUBE &c) {
+        // add cube to top of stack, or defer if above slab
+        if (c.k < kMin)
+            return;
+        CUBES *oldcubes = c.k > kMax? deferred : cubes;
+        CUBES *top = (CUBES *) Alloc(1, sizeof(CUBES)); // freed in March
+        top->cube = c;
+        top->next = oldcubes;
+        if (c.k > kMax) {
+            deferred = top;
+            return;
+        }
+        cubes = top;
+        if (stats && ++stats->stackDepth > stats->peakStackDepth)
+            stats->peakStackDepth = stats->stackDepth;
+    }
+
+    // slab streaming: march cubes kMin-kMax, then prune the tables below the next slab
+
+    void SetSlab(int k1, int k2) {
+        // restrict marching to cubes k1-k2; move deferred cubes within range to stack
+        kMin = k1;
+        kMax = k2;
+        CUBES *d = deferred;
+        deferred = NULL;
+        while (d) {
+            CUBES *next = d->next;
+            Push(d->cube);
+            free(d);
+            d = next;
+        }
+    }
+
+    void Prune(int k) {
+        // free cube centers below k, corners below k-1 (needed for lattice gradients), and
+        // edges with both corners below k
+        for (int index = 0; index < HASHSIZE; index++) {
+            for (CORNERLIST **l = &corners[index]; *l; )
+                if ((*l)->k < k-1) {
+                    CORNERLIST *tmp = *l;
+                    *l = tmp->next;
+                    free(tmp);
+                }
+                else
+                    l = &(*l)->next;
+            for (CENTERLIST **l = &centers[index]; *l; )
+                if ((*l)->k < k) {
+                    CENTERLIST *tmp = *l;
+                    *l = tmp->next;
+                    free(tmp);
+                }
+                else
+                    l = &(*l)->next;
+        }
+        for (int index = 0; index < 2*HASHSIZE; index++)
+            for (EDGELIST **l = &edges[index]; *l; )
+                if ((int) (*l)->k1 < k && (int) (*l)->k2 < k) {
+                    EDGELIST *tmp = *l;
+                    *l = tmp->next;
+                    free(tmp);
+                }
+                else
+                    l = &(*l)->next;
+    }
+
+    void ChainHistograms() {
+        // tally hash chain lengths into stats
+        for (int index = 0; index < HASHSIZE; index++) {
+            int nCorners = 0, nCenters = 0;
+            for (CORNERLIST *l = corners[index]; l; l = l->next)
+                nCorners++;
+            for (CENTERLIST *l = centers[index]; l; l = l->next)
+                nCenters++;
+            stats->cornerChains[PolygonizeStats::ChainBin(nCorners)]++;
+            stats->centerChains[PolygonizeStats::ChainBin(nCenters)]++;
+        }
+        for (int index = 0; index < 2*HASHSIZE; index++) {
+            int nEdges = 0;
+            for (EDGELIST *l = edges[index]; l; l = l->next)
+                nEdges++;
+            stats->edgeChains[PolygonizeStats::ChainBin(nEdges)]++;
+        }
+    }
+
+    void FreeAll () {
+        int index;
+        CORNERLIST *l, *lnext;
+        CENTERLIST *cl, *clnext;
+        EDGELIST *edge, *edgenext;
+        if (corners)
+            for (index = 0; index < HASHSIZE; index++)
+                for (l = corners[index]; l; l = lnext) {
+                    lnext = l->next;
+                    free(l);    // free CORNERLIST
+                }
+        if (centers)
+            for (index = 0; index < HASHSIZE; index++)
+                for (cl = centers[index]; cl; cl = clnext) {
+                    clnext = cl->next;
+                    free(cl);   // free CENTERLIST
+                }
+        if (edges)
+            for (index = 0; index < 2*HASHSIZE; index++)
+                for (edge = edges[index]; edge; edge = edgenext) {
+                    edgenext = edge->next;
+                    free(edge); // free EDGELIST
+                }
+        while (deferred) {
+            CUBES *next = deferred->next;
+            free(deferred);     // free deferred CUBES
+            deferred = next;
+        }
+        free(edges);            // free array of EDGELIST pointers
+        free(corners);          // free array of CORNERLIST pointers
+        free(centers);          // free array of CENTERLIST pointers
+        edges = NULL;
+        corners = NULL;
+        centers = NULL;
+    }
+
+    TEST Find(int sign, vec3 &p) {
+        // search for point with value of given sign (0: neg, 1: pos)
+        int i;
+        TEST test;
+        float range = size;
+        test.ok = 1;
+        for (i = 0; i < 10000; i++) {
+            test.p.x = p.x+range*(RAND()-0.5f);
+            test.p.y = p.y+range*(RAND()-0.5f);
+            test.p.z = p.z+range*(RAND()-0.5f);
+            test.value = field(test.p);
+            if (stats)
+                stats->findEvals++;
+            if (sign == (test.value > 0.0))
+                return test;
+            range = range*1.0005f; // slowly expand search outwards
+        }
+        test.ok = 0;
+        return test;
+    }
+
+    CUBE MakeCube(int3 ijk) {
+        int npos = 0, nneg = 0;
+        CUBE c;
+        c.i = ijk.i1;
+        c.j = ijk.i2;
+        c.k = ijk.i3;
+        for (int n = 0; n < 8; n++) {
+            c.values[n] = SetCorner(c.i+BIT(n,2), c.j+BIT(n,1), c.k+BIT(n,0));
+            float val = c.values[n];
+            val < 0? nneg++ : val > 0? npos++ : 0;
+        }
+        c.transects = nneg > 0 && npos > 0;
+        return c;
+    }
+
+    void AddToStack(CUBE &c) {
+        if (!SetCenter(centers, c.i, c.j, c.k))           // not previously set
+            Push(c);
+    }
+
+    bool AddToStack(vec3 &q) {
+        TEST in, out;
+        in = Find(1, q);
+        out = Find(0, q);
+        if (!in.ok || !out.ok) {
+            // throw("can't find starting point");
+            return false;
+        }
+        vec3 p;
+        Converge(in.p, out.p, in.value, p);
+        AddSurfacePoint(p);
+        return true;
+    }
+
+    void AddSeed(vec3 &pos, vec3 &neg) {
+        // start from the surface between a positive and a negative point
+        vec3 p;
+        Converge(pos, neg, 1, p);
+        AddSurfacePoint(p);
+    }
+
+    bool Polygonized(vec3 &a, vec3 &b) {
+        // true if a vertex has been set for a lattice edge between lattice corners a and b,
+        // which differ along one axis (the surface there has already been polygonized)
+        int3 i1((int) floor(a.x/size+.5f), (int) floor(a.y/size+.5f), (int) floor(a.z/size+.5f));
+        int3 i2((int) floor(b.x/size+.5f), (int) floor(b.y/size+.5f), (int) floor(b.z/size+.5f));
+        int axis = i1.i1 != i2.i1? 0 : i1.i2 != i2.i2? 1 : 2;
+        if (i1[axis] > i2[axis])
+            std::swap(i1, i2);
+        for (int3 c = i1; c[axis] < i2[axis]; c[axis]++) {
+            int3 d = c;
+            d[axis]++;
+            if (GetEdge(edges, c.i1, c.i2, c.i3, d.i1, d.i2, d.i3) != -1)
+                return true;
+        }
+        return false;
+    }
+
+    void AddSurfacePoint(vec3 &p) {
+        int3 ijk = LatticeIJK(p);
+        CUBE c = MakeCube(ijk);
+        if (c.transects)
+            AddToStack(c);
+        else {
+            // no transection (q must graze cube face, edge, or vertex), add face neighbors
+            int3 ids[] = {int3(c.i-1, c.j, c.k), int3(c.i+1, c.j, c.k),
+                          int3(c.i, c.j-1, c.k), int3(c.i, c.j+1, c.k),
+                          int3(c.i, c.j, c.k-1), int3(c.i, c.j, c.k+1)};
+            for (int i = 0; i < 6; i++) {
+                CUBE c = MakeCube(ids[i]);
+                AddToStack(c);
+              }
+        }
+    }
+
+    int3 LatticeIJK(vec3 &p) {
+        return int3((int) floor(p.x/size), (int) floor(p.y/size), (int) floor(p.z/size));
+    }
+
+    bool March(std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max()) {
+        // process active cubes till none left or deadline passes (checked every few cubes);
+        // return false if the sink aborts, leaving the aborted cube on the stack
+        bool noabort, timed = deadline != std::chrono::steady_clock::time_point::max();
+        for (int n = 1; cubes != NULL; n++) {
+            if (timed && !(n&7) && std::chrono::steady_clock::now() >= deadline)
+                break;
+            CUBES *temp = cubes;
+            CUBE c = cubes->cube;
+            BeginCube(sink, c.i, c.j, c.k, 0);
+            noabort =
+                // decompose into tetrahedra and polygonize
+                DoTet(&c, LBN, LTN, RBN, LBF) &&
+                DoTet(&c, RTN, LTN, LBF, RBN) &&
+                DoTet(&c, RTN, LTN, LTF, LBF) &&
+                DoTet(&c, RTN, RBN, LBF, RBF) &&
+                DoTet(&c, RTN, LBF, LTF, RBF) &&
+                DoTet(&c, RTN, LTF, RTF, RBF);
+            if (!noabort)
+                return false;
+            // pop current cube from stack
+            cubes = cubes->next;
+            free((char *) temp);
+            if (stats)
+                stats->stackDepth--;
+            // test six face directions, maybe add to stack
+            TestFace(c.i-1, c.j, c.k, &c, L, LBN, LBF, LTN, LTF);
+            TestFace(c.i+1, c.j, c.k, &c, R, RBN, RBF, RTN, RTF);
+            TestFace(c.i, c.j-1, c.k, &c, B, LBN, LBF, RBN, RBF);
+            TestFace(c.i, c.j+1, c.k, &c, T, LTN, LTF, RTN, RTF);
+            TestFace(c.i, c.j, c.k-1, &c, N, LBN, LTN, RBN, RTN);
+            TestFace(c.i, c.j, c.k+1, &c, F, LBF, LTF, RBF, RTF);
+        }
+        return true;
+    } // end March
+
+    // removal, for incremental update
+
+    bool RemoveCenter(int i, int j, int k) {
+        // return true if cube (i,j,k) had been visited
+        for (CENTERLIST **l = &centers[HASH(i, j, k)]; *l; l = &(*l)->next)
+            if ((*l)->i == i && (*l)->j == j && (*l)->k == k) {
+                CENTERLIST *tmp = *l;
+                *l = tmp->next;
+                free(tmp);
+                return true;
+            }
+        return false;
+    }
+
+    void RemoveStacked(const int3 &lo, const int3 &hi) {
+        // discard active cubes within lo-hi (their values may be stale); centers remain set
+        for (CUBES **l = &cubes; *l; ) {
+            CUBE &c = (*l)->cube;
+            if (c.i >= lo.i1 && c.i <= hi.i1 && c.j >= lo.i2 && c.j <= hi.i2 && c.k >= lo.i3 && c.k <= hi.i3) {
+                CUBES *tmp = *l;
+                *l = tmp->next;
+                free(tmp);
+                if (stats)
+                    stats->stackDepth--;
+            }
+            else
+                l = &(*l)->next;
+        }
+    }
+
+    void RemoveCorner(int i, int j, int k) {
+        for (CORNERLIST **l = &corners[HASH(i, j, k)]; *l; l = &(*l)->next)
+            if ((*l)->i == i && (*l)->j == j && (*l)->k == k) {
+                CORNERLIST *tmp = *l;
+                *l = tmp->next;
+                free(tmp);
+                return;
+            }
+    }
+
+    int RemoveEdge(unsigned int i1, unsigned int j1, unsigned int k1, unsigned int i2, unsigned int j2, unsigned int k2) {
+        // return vertex id of removed edge, or -1 if not set
+        if ((i1>i2) || ((i1==i2) && ((j1>j2) || ((j1==j2) && (k1>k2))))) {
+            unsigned int t;
+            t=i1; i1=i2; i2=t;
+            t=j1; j1=j2; j2=t;
+            t=k1; k1=k2; k2=t;
+        }
+        for (EDGELIST **l = &edges[HASH(i1, j1, k1)+HASH(i2, j2, k2)]; *l; l = &(*l)->next) {
+            EDGELIST *q = *l;
+            if (q->i1 == i1 && q->j1 == j1 && q->k1 == k1 && q->i2 == i2 && q->j2 == j2 && q->k2 == k2) {
+                int vid = q->vid;
+                *l = q->next;
+                free(q);
+                return vid;
+            }
+        }
+        return -1;
+    }
+
+    bool SetCenter(CENTERLIST *table[], int i, int j, int k)    {
+        // set (i,j,k) entry of table[]
+        // return true if already set; otherwise, set and return false
+        int index = HASH(i, j, k);
+        CENTERLIST *newCL, *l, *q = table[index];
+        for (l = q; l != NULL; l = l->next)
+        if (l->i == i && l->j == j && l->k == k)
+            return true;
+        newCL = (CENTERLIST *) Alloc(1, sizeof(CENTERLIST)); // freed in FreeAll
+        newCL->i = i;
+        newCL->j = j;
+        newCL->k = k;
+        newCL->next = q;
+        table[index] = newCL;
+        return false;
+    }
+
+    void TestFace (int i, int j, int k, CUBE *old, int face, int c1, int c2, int c3, int c4) {
+        // given cube at lattice (i, j, k), and four corners of face,
+        // if surface crosses face, compute other four corners of adjacent cube
+        // and add new cube to cube stack
+        static int facebit[6] = {2, 2, 1, 1, 0, 0};
+        int pos = old->values[c1] > 0.0 ? 1 : 0, bit = facebit[face];
+        // test if no surface crossing, cube out of bounds, or already visited
+        if ((old->values[c2] > 0) == pos &&
+            (old->values[c3] > 0) == pos &&
+            (old->values[c4] > 0) == pos)
+            return;
+        if (abs(i) > bounds || abs(j) > bounds || abs(k) > bounds || k < kMin)
+            return;
+        if (SetCenter(centers, i, j, k))
+            return;
+        // create new_obj cube
+        CUBE c;
+        c.i = i;
+        c.j = j;
+        c.k = k;
+        int cids[] = {c1, c2, c3, c4};
+        for (int n = 0; n < 4; n++) {
+            int cid = cids[n];
+            c.values[FLIP(cid, bit)] = old->values[cid];
+            c.values[cid] = SetCorner(i+BIT(cid,2), j+BIT(cid,1), k+BIT(cid,0));
+        }
+        Push(c);
+    }
+
+    CORNERLIST *GetCorner (int i, int j, int k) {
+        // return corner with the given lattice location
+        // set (and cache) its function value; for speed, do corner value caching here
+        int index = HASH(i, j, k);
+        CORNERLIST *l = corners[index];
+        if (stats)
+            stats->cornerLookups++;
+        for (; l != NULL; l = l->next)
+            if (l->i == i && l->j == j && l->k == k) {
+                if (stats)
+                    stats->cornerHits++;
+                return l;
+            }
+        l = (CORNERLIST *) Alloc(1, sizeof(CORNERLIST)); // freed in FreeAll
+        l->i = i; l->j = j; l->k = k;
+        l->value = CornerValue(i, j, k);
+        l->next = corners[index];
+        corners[index] = l;
+        return l;
+    }
+
+    float CornerValue(int i, int j, int k) {
+        // evaluate field at lattice corner, unless another level has
+        bool share = shared && !((i|j|k)&sharedMask);
+        float value;
+        if (share && shared->Get(i*sharedScale, j*sharedScale, k*sharedScale, value)) {
+            if (stats)
+                stats->sharedCornerHits++;
+            return value;
+        }
+        value = field(vec3((float)i*size, (float)j*size, (float)k*size));
+        if (stats)
+            stats->setCornerEvals++;
+        if (share)
+            shared->Set(i*sharedScale, j*sharedScale, k*sharedScale, value);
+        return value;
+    }
+
+    float SetCorner (int i, int j, int k) {
+        return GetCorner(i, j, k)->value;
+    }
+
+    vec3 CornerGradient (int i, int j, int k) {
+        // central difference of cached lattice values; most neighbors are
+        // already set by adjacent cubes, so this rarely calls iProc
+        CORNERLIST *l = GetCorner(i, j, k);
+        if (!l->hasGradient) {
+            float s = .5f/size;
+            l->gradient = vec3(s*(SetCorner(i+1, j, k)-SetCorner(i-1, j, k)),
+                               s*(SetCorner(i, j+1, k)-SetCorner(i, j-1, k)),
+                               s*(SetCorner(i, j, k+1)-SetCorner(i, j, k-1)));
+            l->hasGradient = true;
+        }
+        return l->gradient;
+    }
+
+    bool DoTet(CUBE* cube, int c1, int c2, int c3, int c4) {
+        // b, c, d should appear clockwise when viewed from a
+        // return false if client aborts, true otherwise
+        float a = cube->values[c1], b = cube->values[c2], c = cube->values[c3], d = cube->values[c4];
+        int index = 0, apos, bpos, cpos, dpos, e1 = 0, e2 = 0, e3 = 0, e4 = 0, e5 = 0, e6 = 0;
+        if ((apos = (a > 0.0))) index += 8;
+        if ((bpos = (b > 0.0))) index += 4;
+        if ((cpos = (c > 0.0))) index += 2;
+        if ((dpos = (d > 0.0))) index += 1;
+        // index is now 4-bit number representing one of the 16 possible cases
+        if (apos != bpos && (e1 = VertId(cube, c1, c2)) < 0)
+            return false;
+        if (apos != cpos && (e2 = VertId(cube, c1, c3)) < 0)
+            return false;
+        if (apos != dpos && (e3 = VertId(cube, c1, c4)) < 0)
+            return false;
+        if (bpos != cpos && (e4 = VertId(cube, c2, c3)) < 0)
+            return false;
+        if (bpos != dpos && (e5 = VertId(cube, c2, c4)) < 0)
+            return false;
+        if (cpos != dpos && (e6 = VertId(cube, c3, c4)) < 0)
+            return false;
+        // 14 productive tetrahedral cases (0000 and 1111 do not yield polygons
+        switch (index) {
+            case 1:  return sink.Triangle(e5, e6, e3);
+            case 2:  return sink.Triangle(e2, e6, e4);
+            case 3:  return sink.Triangle(e3, e5, e4) && sink.Triangle(e3, e4, e2);
+            case 4:  return sink.Triangle(e1, e4, e5);
+            case 5:  return sink.Triangle(e3, e1, e4) && sink.Triangle(e3, e4, e6);
+            case 6:  return sink.Triangle(e1, e2, e6) && sink.Triangle(e1, e6, e5);
+            case 7:  return sink.Triangle(e1, e2, e3);
+            case 8:  return sink.Triangle(e1, e3, e2);
+            case 9:  return sink.Triangle(e1, e5, e6) && sink.Triangle(e1, e6, e2);
+            case 10: return sink.Triangle(e1, e3, e6) && sink.Triangle(e1, e6, e4);
+            case 11: return sink.Triangle(e1, e5, e4);
+            case 12: return sink.Triangle(e3, e2, e4) && sink.Triangle(e3, e4, e5);
+            case 13: return sink.Triangle(e6, e2, e4);
+            case 14: return sink.Triangle(e5, e3, e6);
+        }
+        return true;
+    } // end dotet
+
+    void SetEdge(EDGELIST *table[], unsigned int i1, unsigned int j1, unsigned int k1, unsigned int i2, unsigned int j2, unsigned int k2, unsigned int vid) {
+        // set vertex id for edge
+        unsigned int index;
+        EDGELIST *newEL;
+        if ((i1>i2) || ((i1==i2) && ((j1>j2) || ((j1==j2) && (k1>k2))))) {
+            int t;
+            t=i1; i1=i2; i2=t;
+            t=j1; j1=j2; j2=t;
+            t=k1; k1=k2; k2=t;
+        }
+        index = HASH(i1, j1, k1) + HASH(i2, j2, k2);
+        newEL = (EDGELIST *) Alloc(1, sizeof(EDGELIST)); // freed in FreeAll
+        newEL->i1 = i1; newEL->j1 = j1; newEL->k1 = k1;
+        newEL->i2 = i2; newEL->j2 = j2; newEL->k2 = k2;
+        newEL->vid = vid;
+        newEL->next = table[index];
+        table[index] = newEL;
+    }
+
+    int GetEdge(EDGELIST *table[], unsigned int i1, unsigned int j1, unsigned int k1, unsigned int i2, unsigned int j2, unsigned int k2) {
+        // return vertex id for edge; return -1 if not set
+        EDGELIST *q;
+        if ((i1>i2) || ((i1==i2) && ((j1>j2) || ((j1==j2) && (k1>k2))))) {
+            int t;
+            t=i1; i1=i2; i2=t;
+            t=j1; j1=j2; j2=t;
+            t=k1; k1=k2; k2=t;
+        };
+        q = table[HASH(i1, j1, k1)+HASH(i2, j2, k2)];
+        for (; q != NULL; q = q->next)
+            if (q->i1 == i1 && q->j1 == j1 && q->k1 == k1 &&
+                q->i2 == i2 && q->j2 == j2 && q->k2 == k2)
+                    return q->vid;
+        return -1;
+    }
+
+    int VertId(CUBE *c, int c1, int c2) {
+        // vertid: return index for vertex on edge:
+        // c1->value and c2->value are presumed of different sign
+        // return saved index if any; else compute vertex and save
+        int i1 = c->i+BIT(c1,2), j1 = c->j+BIT(c1,1), k1 = c->k+BIT(c1,0);
+        int i2 = c->i+BIT(c2,2), j2 = c->j+BIT(c2,1), k2 = c->k+BIT(c2,0);
+        int vid = GetEdge(edges, i1, j1, k1, i2, j2, k2);
+        if (stats) {
+            stats->edgeLookups++;
+            stats->edgeHits += vid != -1;
+        }
+        if (vid != -1)
+            return vid;                          // previously computed
+        vec3 a((float)i1*size, (float)j1*size, (float)k1*size), v;
+        vec3 b((float)i2*size, (float)j2*size, (float)k2*size), n;
+        Converge(a, b, c->values[c1], v);        // position
+        if (Enabled(gradient))
+            Normal(v, n);                        // analytic normal
+        else {
+            // interpolate lattice gradients at edge ends
+            float t = dot(v-a, b-a)/dot(b-a, b-a);
+            n = (1-t)*CornerGradient(i1, j1, k1)+t*CornerGradient(i2, j2, k2);
+            if (dot(n, n) > 0)
+                n = normalize(n);
+            else
+                Normal(v, n, delta);             // degenerate, use local difference
+        }
+        vid = sink.Vertex(v, n);
+        SetEdge(edges, i1, j1, k1, i2, j2, k2, vid);
+        return vid;
+    }
+
+    void Converge(vec3 &p1, vec3 &p2, float v, vec3 &p) {
+        int i = 0;
+        vec3 pos, neg;
+        if (v < 0) {
+            pos = p2;
+            neg = p1;
+        }
+        else {
+            pos = p1;
+            neg = p2;
+        }
+        while (1) {
+            p = 0.5f*(pos+neg);
+            if (i++ == RES) {
+                if (stats)
+                    stats->convergeEvals += RES;
+                return;
+            }
+            if ((field(p)) > 0.0)
+                 pos = p;
+            else neg = p;
+        }
+    }
+
+    void Normal(vec3 &p, vec3 &n) {
+        gradient(p, n);
+        n = normalize(n);
+        if (stats)
+            stats->normalEvals++;
+    }
+
+    void Normal(vec3 &p, vec3 &n, float delta) {
+        // central difference
+        n.x = field(vec3(p.x+delta, p.y, p.z))-field(vec3(p.x-delta, p.y, p.z));
+        n.y = field(vec3(p.x, p.y+delta, p.z))-field(vec3(p.x, p.y-delta, p.z));
+        n.z = field(vec3(p.x, p.y, p.z+delta))-field(vec3(p.x, p.y, p.z-delta));
+        n = normalize(n);
+        if (stats)
+            stats->normalEvals += 6;
+    }
+
+    Process(Field f, Sink &snk, Gradient g, float s, float d, int b, PolygonizeStats *st = NULL) :
+        field(f), sink(snk), gradient(g), size(s), delta(d), bounds(b), stats(st),
+        kMin(INT_MIN), kMax(INT_MAX), deferred(NULL), shared(NULL), sharedScale(1), sharedMask(0) {
+        // allocate hash tables, freed in FreeAll
+        centers = (CENTERLIST **) Alloc(HASHSIZE, sizeof(CENTERLIST *));
+        corners = (CORNERLIST **) Alloc(HASHSIZE, sizeof(CORNERLIST *));
+        edges = (EDGELIST **) Alloc(2*HASHSIZE, sizeof(EDGELIST *));
+        cubes = NULL;
+    }
+
+    ~Process() {
+        FreeAll();
+    }
+}; // end Process
+
+} // end namespace PolygonizerDetail
+
+// sink adapter for a pair of callables (such as lambdas)
+
+template <class VertexFn, class TriangleFn>
+struct CallbackSink {
+    VertexFn vertexFn;
+    TriangleFn triangleFn;
+    int Vertex(const vec3 &p, const vec3 &n) { return vertexFn(p, n); }
+    bool Triangle(int i1, int i2, int i3) { return triangleFn(i1, i2, i3); }
+};
+
+template <class VertexFn, class TriangleFn>
+CallbackSink<VertexFn, TriangleFn> MakeSink(VertexFn v, TriangleFn t) {
+    CallbackSink<VertexFn, TriangleFn> s = {v, t};
+    return s;
+}
+
+// indexed mesh output: PolyMesh is itself a sink, so vertices and triangles
+// are appended without a call through a function pointer
+
+struct PolyMesh {
+    std::vector<vec3> points, normals;
+    std::vector<int3> triangles;
+    void Reserve(size_t nTriangles) {
+        // a closed surface has about half as many vertices as triangles
+        triangles.reserve(nTriangles);
+        points.reserve(nTriangles/2+1);
+        normals.reserve(nTriangles/2+1);
+    }
+    void Clear() { points.resize(0); normals.resize(0); triangles.resize(0); }
+    int Vertex(const vec3 &p, const vec3 &n) {
+        points.push_back(p);
+        normals.push_back(n);
+        return (int) points.size()-1;
+    }
+    bool Triangle(int i1, int i2, int i3) {
+        triangles.push_back(int3(i1, i2, i3));
+        return true;
+    }
+};
+
+// output to client memory, such as a GL buffer mapped with glMapBufferRange;
+// aborts the polygonizer (which then returns false) when either array is full
+
+struct BufferSink {
+    vec3 *points, *normals;
+    int3 *triangles;
+    int maxPoints, maxTriangles;
+    int nPoints = 0, nTriangles = 0;
+    BufferSink(vec3 *p, vec3 *n, int maxP, int3 *t, int maxT) :
+        points(p), normals(n), triangles(t), maxPoints(maxP), maxTriangles(maxT) { }
+    int Vertex(const vec3 &p, const vec3 &n) {
+        if (nPoints == maxPoints)
+            return -1;
+        points[nPoints] = p;
+        normals[nPoints] = n;
+        return nPoints++;
+    }
+    bool Triangle(int i1, int i2, int i3) {
+        if (nTriangles == maxTriangles)
+            return false;
+        triangles[nTriangles++] = int3(i1, i2, i3);
+        return true;
+    }
+};
+
+// Polygonize
+
+template <class Field, class Sink, class Gradient, class = PolygonizerDetail::GradientCall<Gradient> >
+bool Polygonize(std::vector<vec3> &starts, float cellSize, int bounds, Field field, Sink &&sink, Gradient gradient,
+                PolygonizeStats *stats = NULL) {
+    // return false if the sink aborts
+    // if non-null, stats accumulates counts and times for this run
+    using namespace PolygonizerDetail;
+    typedef std::chrono::steady_clock Clock;
+    typedef typename std::remove_reference<Sink>::type SinkType;
+    Process<Field, SinkType, Gradient> p(field, sink, gradient, cellSize, cellSize/(float)(RES*RES), bounds, stats);
+    Clock::time_point t0 = Clock::now();
+    for (size_t i = 0; i < starts.size(); i++)
+        p.AddToStack(starts[i]);
+    Clock::time_point t1 = Clock::now();
+    bool ok = p.March();
+    if (stats) {
+        Clock::time_point t2 = Clock::now();
+        p.ChainHistograms();
+        p.FreeAll();
+        stats->seedTime += std::chrono::duration<double>(t1-t0).count();
+        stats->marchTime += std::chrono::duration<double>(t2-t1).count();
+        stats->freeTime += std::chrono::duration<double>(Clock::now()-t2).count();
+    }
+    return ok;
+}
+
+template <class Field, class Sink>
+bool Polygonize(std::vector<vec3> &starts, float cellSize, int bounds, Field field, Sink &&sink) {
+    // as above, but normals interpolated from lattice gradients
+    return Polygonize(starts, cellSize, bounds, field, sink, PolygonizerDetail::NoGradient());
+}
+
+template <class Field>
+bool Polygonize(std::vector<vec3> &starts, float cellSize, int bounds, Field field, PolyMesh &mesh, int nTrianglesHint = 0) {
+    // append to mesh; if non-zero, nTrianglesHint reserves space up front
+    if (nTrianglesHint > 0)
+        mesh.Reserve(mesh.triangles.size()+nTrianglesHint);
+    return Polygonize(starts, cellSize, bounds, field, mesh, PolygonizerDetail::NoGradient());
+}
+
+// Seed Discovery
+
+// rather than search randomly from client start points, evaluate the function on a coarse
+// grid (every coarse'th lattice corner) over the lattice +/-bounds, in parallel, and return
+// a positive and negative point on an edge of each sign-changing coarse cell; Polygonize
+// marches from a seed only if its edge has not yet been polygonized, so each component is
+// started once; the result is deterministic, and costs (2*bounds/coarse)^3 evaluations,
+// or, if the field provides Bound, evaluations only at corners of coarse cells that the
+// bound cannot exclude; surface components that cross no coarse edge may be missed, so
+// decrease coarse for small features (which is cheap with Bound)
+
+struct SeedSegment {
+    vec3 pos, neg;              // field positive at pos, not positive at neg
+};
+
+namespace PolygonizerDetail {
+
+template <class Field>
+std::vector<SeedSegment> CoarseSeeds(Field &field, float cellSize, int bounds, int coarse, int nThreads,
+                                     int k0, int nk, PolygonizeStats *stats) {
+    // evaluate coarse grid over lattice +/-bounds in x and y, and nk coarse cells in z from
+    // lattice corner k0; return a seed for each sign-changing coarse cell
+    std::vector<SeedSegment> seeds;
+    int n = (2*bounds+1+coarse-1)/coarse, n1 = n+1;     // n^2 coarse cells span lattice cubes in x, y
+    int nk1 = nk+1;
+    auto Location = [&](int a, int b, int c) {
+        return cellSize*vec3((float)(-bounds+a*coarse), (float)(-bounds+b*coarse), (float)(k0+c*coarse));
+    };
+    auto Index = [n1, nk1](int a, int b, int c) { return (a*n1+b)*nk1+c; };
+    auto Cell = [n, nk](int a, int b, int c) { return (a*n+b)*nk+c; };
+    // cells that may contain surface: all, or those not excluded by field bounds
+    std::vector<char> active(n*n*nk, 1);
+    std::vector<char> needed(n1*n1*nk1, 1);     // corners of active cells
+    if (HasBound<typename Unwrapped<Field>::type>::value) {
+        std::fill(active.begin(), active.end(), 0);
+        std::fill(needed.begin(), needed.end(), 0);
+        long long nBounds = 0;
+        std::vector<std::pair<int3, int3> > blocks(1, std::make_pair(int3(0, 0, 0), int3(n, n, nk)));
+        while (blocks.size()) {
+            // test block [lo, hi) of coarse cells, subdivide along its longest side
+            int3 lo = blocks.back().first, hi = blocks.back().second;
+            blocks.pop_back();
+            nBounds++;
+            if (!MayContainSurface(Unwrap(field), Location(lo.i1, lo.i2, lo.i3), Location(hi.i1, hi.i2, hi.i3), 0))
+                continue;
+            int3 size(hi.i1-lo.i1, hi.i2-lo.i2, hi.i3-lo.i3);
+            if (size.i1 == 1 && size.i2 == 1 && size.i3 == 1) {
+                active[Cell(lo.i1, lo.i2, lo.i3)] = 1;
+                for (int v = 0; v < 8; v++)
+                    needed[Index(lo.i1+BIT(v, 2), lo.i2+BIT(v, 1), lo.i3+BIT(v, 0))] = 1;
+                continue;
+            }
+            int axis = size.i1 >= size.i2 && size.i1 >= size.i3? 0 : size.i2 >= size.i3? 1 : 2;
+            int3 mid = lo;
+            mid[axis] = lo[axis]+size[axis]/2;
+            int3 hi1 = hi, lo2 = lo;
+            hi1[axis] = mid[axis];
+            lo2[axis] = mid[axis];
+            blocks.push_back(std::make_pair(lo2, hi));
+            blocks.push_back(std::make_pair(lo, hi1));
+        }
+        if (stats)
+            stats->intervalEvals += nBounds;
+    }
+    // evaluate needed coarse corners, one x-slice at a time
+    std::vector<float> values(n1*n1*nk1, 0);
+    if (nThreads <= 0)
+        nThreads = (int) std::thread::hardware_concurrency();
+    if (nThreads < 1)
+        nThreads = 1;
+    std::atomic<int> next(0);
+    std::atomic<long long> nEvals(0);
+    auto Slices = [&]() {
+        long long count = 0;
+        std::vector<vec3> points(nk1);
+        std::vector<float> rowValues(nk1);
+        std::vector<int> ids(nk1);
+        for (int a = next++; a < n1; a = next++)
+            for (int b = 0; b < n1; b++) {
+                // gather and evaluate needed corners in row (a, b)
+                int nRow = 0;
+                for (int c = 0; c < nk1; c++)
+                    if (needed[Index(a, b, c)]) {
+                        points[nRow] = Location(a, b, c);
+                        ids[nRow++] = Index(a, b, c);
+                    }
+                EvaluateBatch(Unwrap(field), points.data(), rowValues.data(), nRow, 0);
+                for (int i = 0; i < nRow; i++)
+                    values[ids[i]] = rowValues[i];
+                count += nRow;
+            }
+        nEvals += count;
+    };
+    std::vector<std::thread> threads;
+    for (int t = 1; t < nThreads; t++)
+        threads.push_back(std::thread(Slices));
+    Slices();
+    for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+    if (stats)
+        stats->findEvals += nEvals;
+    // seed from first sign-changing edge of each active cell
+    for (int a = 0; a < n; a++)
+        for (int b = 0; b < n; b++)
+            for (int c = 0; c < nk; c++) {
+                bool found = !active[Cell(a, b, c)];
+                for (int v1 = 0; v1 < 8 && !found; v1++) {
+                    int3 i1(a+BIT(v1, 2), b+BIT(v1, 1), c+BIT(v1, 0));
+                    bool pos1 = values[Index(i1.i1, i1.i2, i1.i3)] > 0;
+                    for (int bit = 0; bit < 3 && !found; bit++) {
+                        int v2 = FLIP(v1, bit);
+                        int3 i2(a+BIT(v2, 2), b+BIT(v2, 1), c+BIT(v2, 0));
+                        if ((values[Index(i2.i1, i2.i2, i2.i3)] > 0) != pos1) {
+                            vec3 p1 = Location(i1.i1, i1.i2, i1.i3), p2 = Location(i2.i1, i2.i2, i2.i3);
+                            SeedSegment s = {pos1? p1 : p2, pos1? p2 : p1};
+                            seeds.push_back(s);
+                            found = true;
+                        }
+                    }
+                }
+            }
+    return seeds;
+}
+
+} // end namespace PolygonizerDetail
+
+template <class Field>
+std::vector<SeedSegment> FindSeeds(Field field, float cellSize, int bounds, int coarse = 8, int nThreads = 0,
+                                   PolygonizeStats *stats = NULL) {
+    // field must be thread-safe if nThreads != 1
+    if (coarse < 1)
+        coarse = 1;
+    int n = (2*bounds+1+coarse-1)/coarse;
+    return PolygonizerDetail::CoarseSeeds(field, cellSize, bounds, coarse, nThreads, -bounds, n, stats);
+}
+
+template <class Field, class Sink, class Gradient, class = PolygonizerDetail::GradientCall<Gradient> >
+bool Polygonize(float cellSize, int bounds, Field field, Sink &&sink, Gradient gradient, int coarse = 8,
+                PolygonizeStats *stats = NULL) {
+    // polygonize all surface components within bounds, seeded by FindSeeds
+    // return false if the sink aborts
+    using namespace PolygonizerDetail;
+    typedef std::chrono::steady_clock Clock;
+    typedef typename std::remove_reference<Sink>::type SinkType;
+    Process<Field, SinkType, Gradient> p(field, sink, gradient, cellSize, cellSize/(float)(RES*RES), bounds, stats);
+    Clock::time_point t0 = Clock::now();
+    std::vector<SeedSegment> seeds = FindSeeds(field, cellSize, bounds, coarse, 0, stats);
+    Clock::time_point t1 = Clock::now();
+    bool ok = true;
+    for (size_t i = 0; i < seeds.size() && ok; i++)
+        if (!p.Polygonized(seeds[i].pos, seeds[i].neg)) {
+            p.AddSeed(seeds[i].pos, seeds[i].neg);
+            ok = p.March();
+        }
+    if (stats) {
+        Clock::time_point t2 = Clock::now();
+        p.ChainHistograms();
+        p.FreeAll();
+        stats->seedTime += std::chrono::duration<double>(t1-t0).count();
+        stats->marchTime += std::chrono::duration<double>(t2-t1).count();
+        stats->freeTime += std::chrono::duration<double>(Clock::now()-t2).count();
+    }
+    return ok;
+}
+
+template <class Field, class Sink>
+bool Polygonize(float cellSize, int bounds, Field field, Sink &&sink) {
+    // as above, but normals interpolated from lattice gradients
+    return Polygonize(cellSize, bounds, field, sink, PolygonizerDetail::NoGradient());
+}
+
+// Slab Streaming
+
+// march the lattice one z-slab (of slabDepth cube layers) at a time, seeding each slab from
+// a coarse grid over the slab; after a slab, cubes that continue upward are deferred to the
+// next slab, and the corner, edge and cube tables are pruned to the shared boundary, so
+// memory is bounded by the slab, not by the surface; a sink may provide void EndSlab(),
+// after which it will not be given vertex ids from before the previous slab (StreamWriter,
+// in Polygonizer.h, writes to binary PLY or STL this way)
+
+template <class Field, class Sink, class Gradient, class = PolygonizerDetail::GradientCall<Gradient> >
+bool PolygonizeSlabs(float cellSize, int bounds, Field field, Sink &&sink, Gradient gradient,
+                     int slabDepth = 32, int coarse = 8, PolygonizeStats *stats = NULL) {
+    // field must be thread-safe (the coarse grid is evaluated concurrently)
+    // return false if the sink aborts
+    using namespace PolygonizerDetail;
+    typedef std::chrono::steady_clock Clock;
+    typedef typename std::remove_reference<Sink>::type SinkType;
+    if (coarse < 1)
+        coarse = 1;
+    slabDepth = coarse*((slabDepth+coarse-1)/coarse);  // slabs aligned with coarse cells
+    if (slabDepth < coarse)
+        slabDepth = coarse;
+    Process<Field, SinkType, Gradient> p(field, sink, gradient, cellSize, cellSize/(float)(RES*RES), bounds, stats);
+    bool ok = true;
+    for (int k1 = -bounds; k1 <= bounds && ok; k1 += slabDepth) {
+        int k2 = k1+slabDepth-1 < bounds? k1+slabDepth-1 : bounds;
+        Clock::time_point t0 = Clock::now();
+        p.Prune(k1);
+        p.SetSlab(k1, k2);
+        int nk = (k2-k1+1+coarse-1)/coarse;
+        std::vector<SeedSegment> seeds = CoarseSeeds(field, cellSize, bounds, coarse, 0, k1, nk, stats);
+        Clock::time_point t1 = Clock::now();
+        ok = p.March();     // continue cubes deferred from previous slab
+        for (size_t i = 0; i < seeds.size() && ok; i++)
+            if (!p.Polygonized(seeds[i].pos, seeds[i].neg)) {
+                p.AddSeed(seeds[i].pos, seeds[i].neg);
+                ok = p.March();
+            }
+        EndSlab(sink, 0);
+        if (stats) {
+            stats->seedTime += std::chrono::duration<double>(t1-t0).count();
+            stats->marchTime += std::chrono::duration<double>(Clock::now()-t1).count();
+        }
+    }
+    if (stats) {
+        Clock::time_point t = Clock::now();
+        p.ChainHistograms();
+        p.FreeAll();
+        stats->freeTime += std::chrono::duration<double>(Clock::now()-t).count();
+    }
+    return ok;
+}
+
+template <class Field, class Sink>
+bool PolygonizeSlabs(float cellSize, int bounds, Field field, Sink &&sink) {
+    // as above, but normals interpolated from lattice gradients
+    return PolygonizeSlabs(cellSize, bounds, field, sink, PolygonizerDetail::NoGradient());
+}
+
+// Levels of Detail
+
+// polygonize at nLevels resolutions in one call: level 0 has cellSize and bounds, and each
+// following level halves the cell size and doubles the bounds, so every level covers the
+// same extent and every lattice corner of a level is a corner of each finer level; corner
+// values are shared between levels (all corners of coarser levels, and the corners of the
+// finest level with even indices, which are the only ones it has in common with the
+// others); seeds are found once, on the finest lattice, and the levels march concurrently,
+// one thread each, so field must be thread-safe; returns meshes coarse to fine, and
+// stats (if given) per level, with seed finding counted in the finest
+
+template <class Field, class Gradient, class = PolygonizerDetail::GradientCall<Gradient> >
+std::vector<PolyMesh> PolygonizeLevels(float cellSize, int bounds, Field field, Gradient gradient, int nLevels,
+                                       int coarse = 8, std::vector<PolygonizeStats> *stats = NULL) {
+    using namespace PolygonizerDetail;
+    typedef std::chrono::steady_clock Clock;
+    std::vector<PolyMesh> meshes(nLevels > 0? nLevels : 0);
+    if (nLevels < 1)
+        return meshes;
+    if (stats)
+        stats->assign(nLevels, PolygonizeStats());
+    int finest = nLevels-1, scale = 1<<finest;
+    float finestSize = cellSize/(float) scale;
+    Clock::time_point t0 = Clock::now();
+    std::vector<SeedSegment> seeds = FindSeeds(field, finestSize, bounds*scale, coarse, 0, stats? &(*stats)[finest] : NULL);
+    if (stats)
+        (*stats)[finest].seedTime += std::chrono::duration<double>(Clock::now()-t0).count();
+    SharedCorners shared;
+    std::vector<std::thread> threads;
+    for (int level = 0; level < nLevels; level++)
+        threads.push_back(std::thread([&, level]() {
+            PolygonizeStats *s = stats? &(*stats)[level] : NULL;
+            float size = cellSize/(float) (1<<level);
+            Process<Field, PolyMesh, Gradient> p(field, meshes[level], gradient, size, size/(float)(RES*RES), bounds<<level, s);
+            p.shared = &shared;
+            p.sharedScale = 1<<(finest-level);
+            p.sharedMask = level == finest && finest > 0? 1 : 0;
+            Clock::time_point t1 = Clock::now();
+            for (size_t i = 0; i < seeds.size(); i++)
+                if (!p.Polygonized(seeds[i].pos, seeds[i].neg)) {
+                    p.AddSeed(seeds[i].pos, seeds[i].neg);
+                    p.March();
+                }
+            if (s) {
+                Clock::time_point t2 = Clock::now();
+                p.ChainHistograms();
+                p.FreeAll();
+                s->marchTime += std::chrono::duration<double>(t2-t1).count();
+                s->freeTime += std::chrono::duration<double>(Clock::now()-t2).count();
+            }
+        }));
+    for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+    return meshes;
+}
+
+template <class Field>
+std::vector<PolyMesh> PolygonizeLevels(float cellSize, int bounds, Field field, int nLevels, int coarse = 8,
+                                       std::vector<PolygonizeStats> *stats = NULL) {
+    // as above, but normals interpolated from lattice gradients
+    return PolygonizeLevels(cellSize, bounds, field, PolygonizerDetail::NoGradient(), nLevels, coarse, stats);
+}
+
+// Incremental Polygonization
+
+// PatchSink: mesh output whose triangles are recorded per cube, so a cube's triangles
+// may be removed and replaced; freed vertex and triangle slots are reused, and removed
+// triangles are left degenerate (0,0,0) until their slot is reused
+
+struct PatchSink {
+    PolyMesh &mesh;
+    std::vector<int> freeVertices, freeTriangles;
+    std::unordered_map<long long, std::vector<int> > cubeTriangles;
+    std::vector<int> *current = NULL;
+    int2 vertexRange, triangleRange;        // [i1, i2) changed since Reset
+    PatchSink(PolyMesh &m) : mesh(m) { }
+    static void Mark(int2 &range, int id) {
+        if (range.i1 == range.i2)
+            range = int2(id, id+1);
+        else {
+            if (id < range.i1) range.i1 = id;
+            if (id >= range.i2) range.i2 = id+1;
+        }
+    }
+    void Reset() { vertexRange = triangleRange = int2(0, 0); }
+    void BeginCube(int i, int j, int k) {
+        current = &cubeTriangles[PolygonizerDetail::LatticeKey(i, j, k)];
+        current->resize(0);
+    }
+    int Vertex(const vec3 &p, const vec3 &n) {
+        int id = (int) mesh.points.size();
+        if (freeVertices.size()) {
+            id = freeVertices.back();
+            freeVertices.pop_back();
+            mesh.points[id] = p;
+            mesh.normals[id] = n;
+        }
+        else
+            mesh.Vertex(p, n);
+        Mark(vertexRange, id);
+        return id;
+    }
+    bool Triangle(int i1, int i2, int i3) {
+        int id = (int) mesh.triangles.size();
+        if (freeTriangles.size()) {
+            id = freeTriangles.back();
+            freeTriangles.pop_back();
+            mesh.triangles[id] = int3(i1, i2, i3);
+        }
+        else
+            mesh.Triangle(i1, i2, i3);
+        current->push_back(id);
+        Mark(triangleRange, id);
+        return true;
+    }
+    void FreeVertex(int id) { freeVertices.push_back(id); }
+    void RemoveCube(int i, int j, int k) {
+        std::unordered_map<long long, std::vector<int> >::iterator it = cubeTriangles.find(PolygonizerDetail::LatticeKey(i, j, k));
+        if (it == cubeTriangles.end())
+            return;
+        std::vector<int> &tris = it->second;
+        for (size_t t = 0; t < tris.size(); t++) {
+            mesh.triangles[tris[t]] = int3(0, 0, 0);
+            freeTriangles.push_back(tris[t]);
+            Mark(triangleRange, tris[t]);
+        }
+        cubeTriangles.erase(it);
+    }
+};
+
+// IncrementalPolygonizer: keeps corner, edge, and cube state between calls; after the
+// field changes within a box, Update re-evaluates only the corners in (or adjacent to)
+// the box and re-marches the cubes that touch them, patching mesh in place;
+// the field is copied, so it should refer to (not contain) the data the client edits
+
+// for progressive display, Seed or Invalidate queue work without marching, and each Step
+// marches what fits in a time budget, for example, once per frame:
+//     inc.Seed(starts);
+//     ...
+//     bool done = inc.Step(2000);          // at most about 2 ms
+//     upload inc.ChangedVertices(), inc.ChangedTriangles() of inc.mesh
+
+template <class Field, class Gradient = PolygonizerDetail::NoGradient>
+class IncrementalPolygonizer {
+public:
+    PolyMesh mesh;
+    IncrementalPolygonizer(Field f, float cellSize, int bounds, Gradient g = Gradient()) :
+        sink(mesh), process(f, sink, g, cellSize, cellSize/(float)(PolygonizerDetail::RES*PolygonizerDetail::RES), bounds) { }
+    bool Polygonize(std::vector<vec3> &starts) {
+        // polygonize from seeds; previously polygonized cubes are not repeated
+        // return false if the sink aborts
+        Seed(starts);
+        return Finish(process.March());
+    }
+    bool Update(const vec3 &boxMin, const vec3 &boxMax, std::vector<vec3> *starts = NULL) {
+        // the field has changed within boxMin-boxMax; optional starts seed surfaces
+        // not connected to previously polygonized cubes (such as a newly separated blob)
+        Invalidate(boxMin, boxMax, starts);
+        return Finish(process.March());
+    }
+    void Seed(std::vector<vec3> &starts) {
+        // as Polygonize, but cubes are only queued, to be marched by Step
+        Begin();
+        for (size_t i = 0; i < starts.size(); i++)
+            process.AddToStack(starts[i]);
+    }
+    void Invalidate(const vec3 &boxMin, const vec3 &boxMax, std::vector<vec3> *starts = NULL) {
+        // as Update, but affected cubes are only queued, to be marched by Step
+        using namespace PolygonizerDetail;
+        Begin();
+        float size = process.size;
+        // dirty corners: within box, plus one for the lattice gradient
+        int3 lo((int) floor(boxMin.x/size)-1, (int) floor(boxMin.y/size)-1, (int) floor(boxMin.z/size)-1);
+        int3 hi((int) ceil(boxMax.x/size)+1, (int) ceil(boxMax.y/size)+1, (int) ceil(boxMax.z/size)+1);
+        // affected cubes: those with a dirty corner
+        std::vector<int3> cubes;
+        for (int i = lo.i1-1; i <= hi.i1; i++)
+            for (int j = lo.i2-1; j <= hi.i2; j++)
+                for (int k = lo.i3-1; k <= hi.i3; k++)
+                    if (process.RemoveCenter(i, j, k)) {
+                        cubes.push_back(int3(i, j, k));
+                        sink.RemoveCube(i, j, k);
+                        RemoveEdges(i, j, k, lo, hi);
+                    }
+        for (int i = lo.i1; i <= hi.i1; i++)
+            for (int j = lo.i2; j <= hi.i2; j++)
+                for (int k = lo.i3; k <= hi.i3; k++)
+                    process.RemoveCorner(i, j, k);
+        // queued cubes with a dirty corner are stale; they are re-made below
+        process.RemoveStacked(int3(lo.i1-1, lo.i2-1, lo.i3-1), hi);
+        // re-march affected cubes that still transect, and any that the surface grows into
+        for (size_t n = 0; n < cubes.size(); n++) {
+            CUBE c = process.MakeCube(cubes[n]);
+            if (c.transects)
+                process.AddToStack(c);
+        }
+        if (starts)
+            for (size_t i = 0; i < starts->size(); i++)
+                process.AddToStack((*starts)[i]);
+    }
+    bool Step(int budgetMicroseconds) {
+        // march queued cubes for about budgetMicroseconds; return true if none remain
+        // (false also if the sink aborts, in which case the aborted cube stays queued)
+        Begin();
+        std::chrono::steady_clock::time_point deadline =
+            std::chrono::steady_clock::now()+std::chrono::microseconds(budgetMicroseconds);
+        return Finish(process.March(deadline)) && process.cubes == NULL;
+    }
+    bool Done() { return process.cubes == NULL; }
+        // true if no cubes are queued
+    int2 ChangedVertices() { return sink.vertexRange; }
+    int2 ChangedTriangles() { return sink.triangleRange; }
+        // [first, last+1) vertex or triangle ids written by the last Polygonize, Update,
+        // or Step, including any Seed or Invalidate since the one before
+private:
+    PatchSink sink;
+    PolygonizerDetail::Process<Field, PatchSink, Gradient> process;
+    bool reported = true;       // changes reported; Begin starts new ranges
+    void Begin() {
+        if (reported)
+            sink.Reset();
+        reported = false;
+    }
+    bool Finish(bool ok) {
+        reported = true;
+        return ok;
+    }
+    void RemoveEdges(int i, int j, int k, const int3 &lo, const int3 &hi) {
+        // free vertices on edges of cube (i,j,k) with a dirty corner
+        using PolygonizerDetail::BIT;
+        for (int c1 = 0; c1 < 8; c1++) {
+            int i1 = i+BIT(c1, 2), j1 = j+BIT(c1, 1), k1 = k+BIT(c1, 0);
+            bool dirty1 = i1 >= lo.i1 && i1 <= hi.i1 && j1 >= lo.i2 && j1 <= hi.i2 && k1 >= lo.i3 && k1 <= hi.i3;
+            for (int c2 = c1+1; c2 < 8; c2++) {
+                int i2 = i+BIT(c2, 2), j2 = j+BIT(c2, 1), k2 = k+BIT(c2, 0);
+                bool dirty2 = i2 >= lo.i1 && i2 <= hi.i1 && j2 >= lo.i2 && j2 <= hi.i2 && k2 >= lo.i3 && k2 <= hi.i3;
+                if (!dirty1 && !dirty2)
+                    continue;
+                int vid = process.RemoveEdge(i1, j1, k1, i2, j2, k2);
+                if (vid >= 0)
+                    sink.FreeVertex(vid);
+            }
+        }
+    }
+};
+
+#endif
@@ -3,6 +3,8 @@
 #ifndef QUATERNION_HDR
 #define QUATERNION_HDR
 
+#include <stddef.h>
+#include <vector>
 #include "VecMat.h"
 
 class Quaternion {
@@ -24,10 +26,51 @@ public:
         float ww = -x*q.x-y*q.y-z*q.z+w*q.w;
         return Quaternion(xx, yy, zz, ww);
     }
-    float Norm() { return x*x+y*y+z*z+w*w; }
-    mat3 Get3x3();
-    mat4 GetMatrix();
-    void Slerp(Quaternion &qu0, Quaternion &qu1, float t);
+    float Norm() const { return x*x+y*y+z*z+w*w; }
+    mat3 Get3x3() const;
+    mat4 GetMatrix() const;
+    void Slerp(const Quaternion &qu0, const Quaternion &qu1, float t);
 };
 
+// quaternions stored as separate x, y, z, and w streams, for animating many orientations;
+// as with Vec3Array, each stream is padded with zeros to a multiple of 16 floats, so
+// kernels run over whole chunks that compilers vectorize
+
+// usage:
+//     QuaternionArray from(keys0), to(keys1), now;
+//     Slerp(from, to, t, now);
+//     Get3x3(now, rotations.data());
+
+class QuaternionArray {
+public:
+    std::vector<float> x, y, z, w;
+    QuaternionArray(size_t n = 0) { Resize(n); }
+    QuaternionArray(const std::vector<Quaternion> &q);
+    size_t Size() const { return size; }
+    size_t Padded() const { return x.size(); }
+    void Resize(size_t n);
+        // existing entries (up to n) are kept, new entries are zero
+    Quaternion Get(size_t i) const { return Quaternion(x[i], y[i], z[i], w[i]); }
+    void Set(size_t i, const Quaternion &q) { x[i] = q.x; y[i] = q.y; z[i] = q.z; w[i] = q.w; }
+    void Store(std::vector<Quaternion> &q) const;
+private:
+    size_t size = 0;
+};
+
+// kernels; arguments must have the same Size, the result is resized to match and may also
+// be an argument; t is a single parameter or an array of Size parameters, in [0, 1]; both
+// interpolations take the shorter arc (negating q1[i] if dot(q0[i], q1[i]) < 0)
+
+void Nlerp(const QuaternionArray &q0, const QuaternionArray &q1, float t, QuaternionArray &r);
+void Nlerp(const QuaternionArray &q0, const QuaternionArray &q1, const float *t, QuaternionArray &r);
+    // normalized linear interpolation: fast, but angular speed varies with t
+
+void Slerp(const QuaternionArray &q0, const QuaternionArray &q1, float t, QuaternionArray &r);
+void Slerp(const QuaternionArray &q0, const QuaternionArray &q1, const float *t, QuaternionArray &r);
+    // spherical linear interpolation of unit quaternions, by a polynomial in t and
+    // dot(q0[i], q1[i]) rather than acos and sin; as accurate as Quaternion::Slerp
+
+void Get3x3(const QuaternionArray &q, mat3 *m);
+    // m[i] = q[i].Get3x3(); m holds Size matrices
+
 #endif
@@ -0,0 +1,36 @@
+// Transform.h - transform arrays of points and normals
+
+#ifndef TRANSFORM_HDR
+#define TRANSFORM_HDR
+
+#include <stddef.h>
+#include "VecMat.h"
+
+// points are processed in blocks, de-interleaved into x, y, and z arrays so that the
+// arithmetic vectorizes; large arrays are split among threads; out may equal in
+
+void TransformPoints(const mat4 &m, const vec3 *in, vec3 *out, size_t n);
+    // out[i] = m*in[i], with in[i] given w = 1 and no divide by the resulting w
+    // (use ProjectToScreen for perspective)
+
+void TransformNormals(const mat4 &m, const vec3 *in, vec3 *out, size_t n, bool unitize = true);
+    // out[i] = upper-left 3x3 of m times in[i], unit length if unitize; if m scales
+    // non-uniformly, pass the inverse transpose of the point transformation
+
+void ProjectToScreen(const mat4 &fullview, const int *viewport, const vec3 *in, vec2 *out, size_t n, float *zscreen = NULL);
+    // out[i] = pixel location of in[i] (as ScreenPoint, in Draw.h), for viewport x, y,
+    // width, height (as from glGetIntegerv(GL_VIEWPORT)); if non-null, set zscreen[i]
+    // to transformed z (before divide by w)
+
+template <class T>
+inline Vec<T, 3> Unproject(const Vec<T, 3> &screen, const Mat<T, 4> &invFullview, const int *viewport) {
+    // inverse of ProjectToScreen (as gluUnProject, but without GL): screen x, y in pixels,
+    // z in depth range 0-1; invFullview is Inverse(persp*modelview); for distant or
+    // nearly parallel geometry, use double (dvec3, Inverse(dmat4(persp*modelview)))
+    Vec<T, 4> ndc(2*(screen.x-(T) viewport[0])/(T) viewport[2]-1,
+                  2*(screen.y-(T) viewport[1])/(T) viewport[3]-1, 2*screen.z-1, 1);
+    Vec<T, 4> p = invFullview*ndc;
+    return Vec<T, 3>(p.x, p.y, p.z)/p.w;
+}
+
+#endif
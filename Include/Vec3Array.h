@@ -0,0 +1,65 @@
+// Vec3Array.h - 3D vectors stored as separate x, y, and z streams, for bulk operations
+
+#ifndef VEC3ARRAY_HDR
+#define VEC3ARRAY_HDR
+
+#include <stddef.h>
+#include <vector>
+#include "VecMat.h"
+
+// each stream is 64-byte aligned and padded with zeros to a multiple of 16 floats, so
+// kernels run over whole 16-float chunks that compilers vectorize (SSE, AVX, or NEON)
+// without remainder loops; the padding is kept zero (kernels write only within Size
+// or write zero results there)
+
+// usage:
+//     Vec3Array a(mesh.points), n(mesh.normals);
+//     TransformPoints(modelview, a, a);
+//     Normalize(n);
+//     a.Store(mesh.points);
+
+class Vec3Array {
+public:
+    float *x = NULL, *y = NULL, *z = NULL;
+    Vec3Array(size_t n = 0) { Resize(n); }
+    Vec3Array(const std::vector<vec3> &v) { Load(v); }
+    Vec3Array(const Vec3Array &a);
+    Vec3Array &operator = (const Vec3Array &a);
+    ~Vec3Array();
+    size_t Size() const { return size; }
+    size_t Padded() const { return padded; }
+        // stream length, a multiple of 16
+    void Resize(size_t n);
+        // existing entries (up to n) are kept, new entries are zero
+    vec3 Get(size_t i) const { return vec3(x[i], y[i], z[i]); }
+    void Set(size_t i, const vec3 &v) { x[i] = v.x; y[i] = v.y; z[i] = v.z; }
+    void Load(const vec3 *v, size_t n);
+    void Load(const std::vector<vec3> &v) { Load(v.data(), v.size()); }
+        // resize to n and de-interleave v
+    void Store(vec3 *v) const;
+    void Store(std::vector<vec3> &v) const { v.resize(size); Store(v.data()); }
+        // interleave into v
+    void ClearPadding();
+        // zero entries Size through Padded-1 (after a kernel that may set them)
+private:
+    float *data = NULL;         // x, y, and z streams, consecutively
+    size_t size = 0, padded = 0;
+};
+
+// kernels; arguments must have the same Size, results are resized to match, and a
+// result may also be an argument
+
+void Add(const Vec3Array &a, const Vec3Array &b, Vec3Array &r);
+void Subtract(const Vec3Array &a, const Vec3Array &b, Vec3Array &r);
+void Scale(Vec3Array &a, float s);
+void Dot(const Vec3Array &a, const Vec3Array &b, float *r);
+    // r[i] = dot(a[i], b[i]); r must hold Padded floats
+void Cross(const Vec3Array &a, const Vec3Array &b, Vec3Array &r);
+void Normalize(Vec3Array &a);
+    // zero-length vectors are left zero
+void MinMax(const Vec3Array &a, vec3 &min, vec3 &max);
+    // bounds of the first Size vectors (min = FLT_MAX, max = -FLT_MAX if empty)
+void TransformPoints(const mat4 &m, const Vec3Array &in, Vec3Array &out);
+    // as TransformPoints in Transform.h: out[i] = m*in[i], w = 1, no divide
+
+#endif
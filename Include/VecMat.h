@@ -5,6 +5,17 @@
 
 #include <math.h>
 #include <iostream>
+#include <type_traits>
+
+// mat4 products use SSE2 on x86/x64, NEON on ARM, else scalar code;
+// define VECMAT_SCALAR to force the scalar code
+#if !defined(VECMAT_SCALAR) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+    #define VECMAT_SSE
+    #include <emmintrin.h>
+#elif !defined(VECMAT_SCALAR) && (defined(__ARM_NEON) || defined(_M_ARM64))
+    #define VECMAT_NEON
+    #include <arm_neon.h>
+#endif
 
 // integer pair and triplet
 
@@ -36,164 +47,208 @@ struct int4 {
 
 // vector representation
 //     vec2/vec3/vec4 v;        // defaults to zero vector
+//     Vec<T, N> v;             // in general, N (2, 3, or 4) components of type T, such
+//                              // as double (dvec3) or float8 (vec3x8: eight vec3s at once)
 // access
 //     float f = v[i];
-// class operations
+// operations
 //     -v                       // negate v
 //     a-b                      // subtract b from a
-//     a+b                      // add v
-//     *s                       // multiply by s
-//     /s                       // divide by s
-//     a*b                      // dot product of a and b
+//     a+b                      // add b to a
+//     v*s, s*v                 // multiply by s
+//     v/s                      // divide by s
+//     a*b                      // componentwise product of a and b
 //     also reflexively: -=, +=, *=, /=
-// non-class operations
 //     dot                      // dot product
 //     length                   // magnitude
 //     normalize                // set to unit length
-//     cross                    // cross product
+//     cross                    // cross product (3D only)
+// the operations are friends of VecOps, a base of each Vec, found by argument-dependent
+// lookup; they are not templates, so either operand may convert (as a scalar to a vector)
 
-//  2D vector
+// eight floats operated on together: two SSE or NEON registers, else arrays; as the
+// component type of a Vec, eight vectors are processed in parallel
 
-class vec2 {
+class float8 {
 public:
-    float x, y;
-    // constructors
-    vec2(float s = 0) : x(s), y(s) { }
-    vec2(float x, float y) : x(x), y(y) { }
-    vec2(float *p) : x(p[0]), y(p[1]) { }
-    vec2(const vec2 &v) : x(v.x), y(v.y) { }
-    vec2(const float *p) : x(p[0]), y(p[1]) { }
-    // access
-    float &operator [] (int i) { return *(&x+i); }
-    const float operator [] (int i) const { return *(&x+i); }
-    operator const float* () const { return static_cast<const float*>(&x); }
-    operator float* () { return static_cast<float*>(&x); }
-    // operations
-    vec2 operator - () const { return vec2(-x, -y); }
-    vec2 operator + (const vec2 &v) const { return vec2(x+v.x, y+v.y); }
-    vec2 operator - (const vec2 &v) const { return vec2(x-v.x, y-v.y); }
-    vec2 operator * (float s) const { return vec2(s*x, s*y); }
-    vec2 operator * (const vec2 &v) const { return vec2(x*v.x, y*v.y); }
-    friend vec2 operator * (float s, const vec2 &v) { return v*s; }
-    vec2 operator / (float s) const { float r = 1.f/s; return *this*r; }
-    // reflexive
-    vec2 &operator += (const vec2 &v) { x += v.x; y += v.y; return *this; }
-    vec2 &operator -= (const vec2 &v) { x -= v.x; y -= v.y; return *this; }
-    vec2 &operator *= (float s) { x *= s; y *= s; return *this; }
-    vec2 &operator *= (const vec2 &v) { x *= v.x; y *= v.y; return *this; }
-    vec2 &operator /= (float s) { float r = 1.f/s; *this *= r; return *this; }
+    float8(float s = 0) : lo(Set4(s)), hi(Set4(s)) { }
+    explicit float8(const float *p) : lo(Load4(p)), hi(Load4(p+4)) { }
+        // load eight consecutive floats
+    void Store(float *p) const { Store4(p, lo); Store4(p+4, hi); }
+    float operator [] (int i) const { float f[8]; Store(f); return f[i]; }
+    friend float8 operator - (const float8 &a) { return float8(Negate4(a.lo), Negate4(a.hi)); }
+    friend float8 operator + (const float8 &a, const float8 &b) { return float8(Add4(a.lo, b.lo), Add4(a.hi, b.hi)); }
+    friend float8 operator - (const float8 &a, const float8 &b) { return float8(Subtract4(a.lo, b.lo), Subtract4(a.hi, b.hi)); }
+    friend float8 operator * (const float8 &a, const float8 &b) { return float8(Multiply4(a.lo, b.lo), Multiply4(a.hi, b.hi)); }
+    friend float8 operator / (const float8 &a, const float8 &b) { return float8(Divide4(a.lo, b.lo), Divide4(a.hi, b.hi)); }
+    friend float8 sqrt(const float8 &a) { return float8(Sqrt4(a.lo), Sqrt4(a.hi)); }
+    friend float8 Min(const float8 &a, const float8 &b) { return float8(Min4(a.lo, b.lo), Min4(a.hi, b.hi)); }
+    friend float8 Max(const float8 &a, const float8 &b) { return float8(Max4(a.lo, b.lo), Max4(a.hi, b.hi)); }
+    float8 &operator += (const float8 &a) { return *this = *this+a; }
+    float8 &operator -= (const float8 &a) { return *this = *this-a; }
+    float8 &operator *= (const float8 &a) { return *this = *this*a; }
+    float8 &operator /= (const float8 &a) { return *this = *this/a; }
+private:
+#if defined(VECMAT_SSE)
+    typedef __m128 Half;
+    static Half Set4(float s) { return _mm_set1_ps(s); }
+    static Half Load4(const float *p) { return _mm_loadu_ps(p); }
+    static void Store4(float *p, Half a) { _mm_storeu_ps(p, a); }
+    static Half Negate4(Half a) { return _mm_xor_ps(a, _mm_set1_ps(-0.f)); }
+    static Half Add4(Half a, Half b) { return _mm_add_ps(a, b); }
+    static Half Subtract4(Half a, Half b) { return _mm_sub_ps(a, b); }
+    static Half Multiply4(Half a, Half b) { return _mm_mul_ps(a, b); }
+    static Half Divide4(Half a, Half b) { return _mm_div_ps(a, b); }
+    static Half Sqrt4(Half a) { return _mm_sqrt_ps(a); }
+    static Half Min4(Half a, Half b) { return _mm_min_ps(a, b); }
+    static Half Max4(Half a, Half b) { return _mm_max_ps(a, b); }
+#elif defined(VECMAT_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+    typedef float32x4_t Half;           // (32-bit NEON lacks divide and square root)
+    static Half Set4(float s) { return vdupq_n_f32(s); }
+    static Half Load4(const float *p) { return vld1q_f32(p); }
+    static void Store4(float *p, Half a) { vst1q_f32(p, a); }
+    static Half Negate4(Half a) { return vnegq_f32(a); }
+    static Half Add4(Half a, Half b) { return vaddq_f32(a, b); }
+    static Half Subtract4(Half a, Half b) { return vsubq_f32(a, b); }
+    static Half Multiply4(Half a, Half b) { return vmulq_f32(a, b); }
+    static Half Divide4(Half a, Half b) { return vdivq_f32(a, b); }
+    static Half Sqrt4(Half a) { return vsqrtq_f32(a); }
+    static Half Min4(Half a, Half b) { return vminq_f32(a, b); }
+    static Half Max4(Half a, Half b) { return vmaxq_f32(a, b); }
+#else
+    struct Half { float f[4]; };
+    static Half Set4(float s) { Half r; for (int i = 0; i < 4; i++) r.f[i] = s; return r; }
+    static Half Load4(const float *p) { Half r; for (int i = 0; i < 4; i++) r.f[i] = p[i]; return r; }
+    static void Store4(float *p, Half a) { for (int i = 0; i < 4; i++) p[i] = a.f[i]; }
+    static Half Negate4(Half a) { for (int i = 0; i < 4; i++) a.f[i] = -a.f[i]; return a; }
+    static Half Add4(Half a, Half b) { for (int i = 0; i < 4; i++) a.f[i] += b.f[i]; return a; }
+    static Half Subtract4(Half a, Half b) { for (int i = 0; i < 4; i++) a.f[i] -= b.f[i]; return a; }
+    static Half Multiply4(Half a, Half b) { for (int i = 0; i < 4; i++) a.f[i] *= b.f[i]; return a; }
+    static Half Divide4(Half a, Half b) { for (int i = 0; i < 4; i++) a.f[i] /= b.f[i]; return a; }
+    static Half Sqrt4(Half a) { for (int i = 0; i < 4; i++) a.f[i] = sqrtf(a.f[i]); return a; }
+    static Half Min4(Half a, Half b) { for (int i = 0; i < 4; i++) a.f[i] = b.f[i] < a.f[i]? b.f[i] : a.f[i]; return a; }
+    static Half Max4(Half a, Half b) { for (int i = 0; i < 4; i++) a.f[i] = b.f[i] > a.f[i]? b.f[i] : a.f[i]; return a; }
+#endif
+    Half lo, hi;                        // lanes 0-3 and 4-7
+    float8(Half lo, Half hi) : lo(lo), hi(hi) { }
 };
 
-inline float dot(const vec2 &a, const vec2 &b) { return a.x*b.x+a.y*b.y; }
-inline float length(const vec2 &v) { return sqrt(dot(v,v)); }
-inline vec2 normalize(const vec2 &v) { return v/length(v); }
+template <class T, int N> class Vec;
 
-//  3D vector
+template <class V, class T, int N>
+class VecOps {
+    // operations common to Vec<T, 2>, Vec<T, 3>, and Vec<T, 4>, each of which supplies
+    // Map (apply F::Do to corresponding components) and Sum (of components)
+    struct Negate { static constexpr T Do(const T &a, const T &) { return -a; } };
+    struct Add { static constexpr T Do(const T &a, const T &b) { return a+b; } };
+    struct Subtract { static constexpr T Do(const T &a, const T &b) { return a-b; } };
+    struct Multiply { static constexpr T Do(const T &a, const T &b) { return a*b; } };
+public:
+    friend constexpr V operator - (const V &v) { return V::template Map<Negate>(v, v); }
+    friend constexpr V operator + (const V &a, const V &b) { return V::template Map<Add>(a, b); }
+    friend constexpr V operator - (const V &a, const V &b) { return V::template Map<Subtract>(a, b); }
+    friend constexpr V operator * (const V &a, const V &b) { return V::template Map<Multiply>(a, b); }
+    friend constexpr V operator * (const V &v, T s) { return V::template Map<Multiply>(v, V(s)); }
+    friend constexpr V operator * (T s, const V &v) { return v*s; }
+    friend constexpr V operator / (const V &v, T s) { return v*(T(1)/s); }
+    // reflexive
+    friend constexpr V &operator += (V &a, const V &b) { return a = a+b; }
+    friend constexpr V &operator -= (V &a, const V &b) { return a = a-b; }
+    friend constexpr V &operator *= (V &a, T s) { return a = a*s; }
+    friend constexpr V &operator *= (V &a, const V &b) { return a = a*b; }
+    friend constexpr V &operator /= (V &a, T s) { return a = a/s; }
+    // non-class
+    friend constexpr T dot(const V &a, const V &b) { return (a*b).Sum(); }
+    friend T length(const V &v) { return sqrt(dot(v, v)); }
+    friend V normalize(const V &v) { return v/length(v); }
+};
+
+//  2D vector
 
-class vec3 {
+template <class T>
+class Vec<T, 2> : public VecOps<Vec<T, 2>, T, 2> {
 public:
-    float  x, y, z;
+    T x, y;
     // constructors
-    vec3(float s = 0) : x(s), y(s), z(s) { }
-    vec3(float x, float y, float z) : x(x), y(y), z(z) { }
-    vec3(const vec3 &v) { x = v.x; y = v.y; z = v.z; }
-    vec3(const vec2 &v, float f) { x = v.x; y = v.y; z = f; }
-    vec3(const float *p) : x(p[0]), y(p[1]), z(p[2]) { }
+    constexpr Vec(T s = T(0)) noexcept : x(s), y(s) { }
+    constexpr Vec(T x, T y) noexcept : x(x), y(y) { }
+    constexpr Vec(const T *p) noexcept : x(p[0]), y(p[1]) { }
+    template <class U> constexpr explicit Vec(const Vec<U, 2> &v) noexcept : x(T(v.x)), y(T(v.y)) { }
     // access
-    float &operator [] (int i) { return *(&x+i); } // causes ambiguity
-    const float operator [] (int i) const { return *(&x+i); }
-    // arithmetic
-    vec3 operator - () const { return vec3(-x, -y, -z); }
-    vec3 operator + (const vec3 &v) const { return vec3(x+v.x, y+v.y, z+v.z); }
-    vec3 operator - (const vec3 &v) const { return vec3(x-v.x, y-v.y, z-v.z); }
-    vec3 operator * (float s) const { return vec3(s*x, s*y, s*z); }
-    vec3 operator * (const vec3 &v) const { return vec3(x*v.x, y*v.y, z*v.z); }
-    friend vec3 operator * (float s, const vec3 &v) { return v*s; }
-    vec3 operator / (float s) const { float r = 1.f/s; return *this * r; }
-    // reflexive
-    vec3 &operator += (const vec3 &v) { x += v.x; y += v.y; z += v.z; return *this; }
-    vec3 &operator -= (const vec3 &v) { x -= v.x; y -= v.y; z -= v.z; return *this; }
-    vec3 &operator *= (float s) { x *= s; y *= s; z *= s; return *this; }
-    vec3 &operator *= (const vec3 &v) { x *= v.x; y *= v.y; z *= v.z; return *this; }
-    vec3 &operator /= (float s) { float r = 1.f/s; *this *= r; return *this; }
+    T &operator [] (int i) { return *(&x+i); }
+    const T operator [] (int i) const { return *(&x+i); }
+    operator const T* () const { return static_cast<const T*>(&x); }
+    operator T* () { return static_cast<T*>(&x); }
+    // for VecOps
+    template <class F> static constexpr Vec Map(const Vec &a, const Vec &b) { return Vec(F::Do(a.x, b.x), F::Do(a.y, b.y)); }
+    constexpr T Sum() const { return x+y; }
+    static constexpr Vec Axis(int i) { return Vec(T(i == 0), T(i == 1)); }
 };
 
-inline float dot(const vec3 &a, const vec3 &b) { return a.x*b.x+a.y*b.y+a.z*b.z; }
-inline float length(const vec3 &v) { return sqrt(dot(v,v)); }
-inline vec3 normalize(const vec3 &v) { return v/length(v); }
-inline vec3 cross(const vec3 &a, const vec3 &b) { return vec3(a.y*b.z-a.z*b.y, a.z*b.x-a.x*b.z, a.x*b.y-a.y*b.x); }
-    // right-handed cross-product
-
-// 4D vector
+//  3D vector
 
-class vec4 {
+template <class T>
+class Vec<T, 3> : public VecOps<Vec<T, 3>, T, 3> {
 public:
-    float x, y, z, w;
+    T x, y, z;
     // constructors
-    vec4(float s = 0) : x(s), y(s), z(s), w(s) { }
-    vec4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) { }
-    vec4(const vec4 &v) { x = v.x; y = v.y;  z = v.z;  w = v.w; }
-    vec4(float *p) : x(p[0]), y(p[1]), z(p[2]), w(p[3]) { }
-    vec4(const vec2 &v, float z, float w) : x(v.x), y(v.y), z(z), w(w) { }
-    vec4(const vec3 &v, float w = 1) : x(v.x), y(v.y), z(v.z), w(w) { }
+    constexpr Vec(T s = T(0)) noexcept : x(s), y(s), z(s) { }
+    constexpr Vec(T x, T y, T z) noexcept : x(x), y(y), z(z) { }
+    constexpr Vec(const Vec<T, 2> &v, T f) noexcept : x(v.x), y(v.y), z(f) { }
+    constexpr Vec(const T *p) noexcept : x(p[0]), y(p[1]), z(p[2]) { }
+    template <class U> constexpr explicit Vec(const Vec<U, 3> &v) noexcept : x(T(v.x)), y(T(v.y)), z(T(v.z)) { }
     // access
-    float &operator [] (int i) { return *(&x+i); }
-    const float operator [] (int i) const { return *(&x+i); }
-    operator const float* () const { return static_cast<const float*>(&x); }
-    operator float* () { return static_cast<float*>(&x); }
-    // arithmetic
-    vec4 operator - () const { return vec4(-x, -y, -z, -w); }
-    vec4 operator + (const vec4 &v) const { return vec4(x+v.x, y+v.y, z+v.z, w+v.w); }
-    vec4 operator - (const vec4 &v) const { return vec4(x-v.x, y-v.y, z-v.z, w-v.w); }
-    vec4 operator * (float s) const { return vec4(s*x, s*y, s*z, s*w); }
-    vec4 operator * (const vec4 &v) const { return vec4(x*v.x, y*v.y, z*v.z, w*v.z); }
-    friend vec4 operator * (float s, const vec4& v) { return v*s; }
-    vec4 operator / (float s) const { float r = 1.f/s; return *this*r; }
-    // reflexive
-    vec4 &operator += (const vec4 &v) { x += v.x;  y += v.y;  z += v.z;  w += v.w; return *this; }
-    vec4 &operator -= (const vec4 &v) { x -= v.x;  y -= v.y;  z -= v.z;  w -= v.w; return *this; }
-    vec4 &operator *= (float s) { x *= s;  y *= s;  z *= s;  w *= s; return *this; }
-    vec4 &operator *= (const vec4 &v) { x *= v.x, y *= v.y, z *= v.z, w *= v.w; return *this; }
-    vec4 &operator /= (float s) { float r = 1.f/s; *this *= r; return *this; }
+    T &operator [] (int i) { return *(&x+i); } // causes ambiguity
+    const T operator [] (int i) const { return *(&x+i); }
+    // for VecOps
+    template <class F> static constexpr Vec Map(const Vec &a, const Vec &b) { return Vec(F::Do(a.x, b.x), F::Do(a.y, b.y), F::Do(a.z, b.z)); }
+    constexpr T Sum() const { return x+y+z; }
+    static constexpr Vec Axis(int i) { return Vec(T(i == 0), T(i == 1), T(i == 2)); }
+    // non-class
+    friend constexpr Vec cross(const Vec &a, const Vec &b) { return Vec(a.y*b.z-a.z*b.y, a.z*b.x-a.x*b.z, a.x*b.y-a.y*b.x); }
+        // right-handed cross-product
 };
 
-inline float dot(const vec4 &a, const vec4 &b) { return a.x*b.x+a.y*b.y+a.z*b.z+a.w*b.w; }
-inline float length(const vec4 &v) { return sqrt(dot(v, v)); }
-inline vec4 normalize(const vec4 &v) { return v/length(v); }
+// 4D vector
 
-// 3x3 matrix representation (used by some quaternion related operations)
-class mat3 {
+template <class T>
+class Vec<T, 4> : public VecOps<Vec<T, 4>, T, 4> {
 public:
-    vec3 row[3];
-    //  constructors
-    mat3(float diag = 1) { row[0].x = row[1].y = row[2].z = diag; }
-    mat3(const vec3 &r0, const vec3 &r1, const vec3 &r2) { row[0] = r0; row[1] = r1; row[2] = r2; }
-    mat3(const mat3 &m) { for (int i = 0; i < 3; i++) row[i] = m.row[i]; }
+    T x, y, z, w;
+    // constructors
+    constexpr Vec(T s = T(0)) noexcept : x(s), y(s), z(s), w(s) { }
+    constexpr Vec(T x, T y, T z, T w) noexcept : x(x), y(y), z(z), w(w) { }
+    constexpr Vec(const T *p) noexcept : x(p[0]), y(p[1]), z(p[2]), w(p[3]) { }
+    constexpr Vec(const Vec<T, 2> &v, T z, T w) noexcept : x(v.x), y(v.y), z(z), w(w) { }
+    constexpr Vec(const Vec<T, 3> &v, T w = T(1)) noexcept : x(v.x), y(v.y), z(v.z), w(w) { }
+    template <class U> constexpr explicit Vec(const Vec<U, 4> &v) noexcept : x(T(v.x)), y(T(v.y)), z(T(v.z)), w(T(v.w)) { }
     // access
-    vec3 &operator [] (int i) { return row[i]; }
-    const vec3 &operator [] (int i) const { return row[i]; }
-    operator const float *() const { return static_cast<const float*>(&row[0].x); }
-    // methods
-    mat3 operator * (float s) const { return mat3(s*row[0], s*row[1], s*row[2]); }
-    friend mat3 operator * (float s, const mat3 &m) { return m*s; }
-    mat3 operator * (const mat3 &m) const {
-        mat3 a(0);
-        for (int i = 0; i < 3; i++)
-            for (int j = 0; j < 3; j++)
-                for (int k = 0; k < 3; k++)
-                    a[i][j] += row[i][k]*m[k][j];
-        return a;
-    }
-    vec3 operator * (const vec3 &v) const { return vec3(dot(row[0], v), dot(row[1], v), dot(row[2], v)); }
+    T &operator [] (int i) { return *(&x+i); }
+    const T operator [] (int i) const { return *(&x+i); }
+    operator const T* () const { return static_cast<const T*>(&x); }
+    operator T* () { return static_cast<T*>(&x); }
+    // for VecOps
+    template <class F> static constexpr Vec Map(const Vec &a, const Vec &b) { return Vec(F::Do(a.x, b.x), F::Do(a.y, b.y), F::Do(a.z, b.z), F::Do(a.w, b.w)); }
+    constexpr T Sum() const { return x+y+z+w; }
+    static constexpr Vec Axis(int i) { return Vec(T(i == 0), T(i == 1), T(i == 2), T(i == 3)); }
 };
 
-// 4x4 matrix
-
-// representation
-//     mat4 m;                  // defaults to identity matrix
+typedef Vec<float, 2> vec2;
+typedef Vec<float, 3> vec3;
+typedef Vec<float, 4> vec4;
+typedef Vec<double, 2> dvec2;
+typedef Vec<double, 3> dvec3;
+typedef Vec<double, 4> dvec4;
+typedef Vec<float8, 2> vec2x8;
+typedef Vec<float8, 3> vec3x8;
+typedef Vec<float8, 4> vec4x8;
+
+// matrix representation
+//     mat3/mat4 m;             // defaults to identity matrix
 //     vec4 v0, v1, v2, v3;
 //     mat4 m(v0, v1, v2, v3);  // four rows
 //     mat4 m2(m);              // copy of m
+//     Mat<T, N> m;             // in general, N (3 or 4) rows of Vec<T, N> (dmat4, etc.)
 // access
 //     vec4 &row0 = m[0];
 //     float f = m[i][j];
@@ -201,42 +256,168 @@ public:
 //     mat4 mm = m1*m2;         // matrix times matrix
 //     mat4 sm = s*m1;          // matrix times scalar
 //     vec4 xv = m*v;           // matrix times vector
+//     MultiplyAffine(m1, m2)   // m1*m2, if both have bottom row (0,0,0,1)
 // initializations
 //     Scale, Translate, RotateX, RotateY, RotateZ
 //     Orthographic, Perspective
-//     LookAt, Transpose
+//     LookAt, Transpose, Inverse, InverseAffine
 
-class mat4 {
+template <class T, int N>
+class Mat {
 public:
-    vec4 row[4];
-    //  constructors
-    mat4(float diag = 1) { row[0].x = row[1].y = row[2].z = row[3].w = diag; }
-    mat4(const vec4 &r0, const vec4 &r1, const vec4 &r2, const vec4 &r3) { row[0] = r0; row[1] = r1; row[2] = r2; row[3] = r3; }
-    mat4(const mat4 &m) { for (int i = 0; i < 4; i++) row[i] = m.row[i]; }
-    mat4(const mat3 &m) {
-        for (int i = 0; i < 3; i++)
-            for (int j = 0; j < 3; j++)
-                row[i][j] = m[i][j];
-        row[3][3] = 1;
+    typedef Vec<T, N> Row;
+    Row row[N];
+    // constructors
+    constexpr Mat(T diag = T(1)) noexcept {
+        for (int i = 0; i < N; i++)
+            row[i] = Row::Axis(i)*diag;
+    }
+    template <int M = N, class = typename std::enable_if<M == 3>::type>
+    constexpr Mat(const Row &r0, const Row &r1, const Row &r2) noexcept : row{r0, r1, r2} { }
+    template <int M = N, class = typename std::enable_if<M == 4>::type>
+    constexpr Mat(const Row &r0, const Row &r1, const Row &r2, const Row &r3) noexcept : row{r0, r1, r2, r3} { }
+    template <int M = N, class = typename std::enable_if<M == 4>::type>
+    constexpr Mat(const Mat<T, 3> &m) noexcept :
+        row{Row(m.row[0], T(0)), Row(m.row[1], T(0)), Row(m.row[2], T(0)), Row(T(0), T(0), T(0), T(1))} { }
+    template <class U> constexpr explicit Mat(const Mat<U, N> &m) noexcept {
+        for (int i = 0; i < N; i++)
+            row[i] = Row(m.row[i]);
     }
     // access
-    vec4 &operator [] (int i) { return row[i]; }
-    const vec4 &operator [] (int i) const { return row[i]; }
-    operator const float *() const { return static_cast<const float*>(&row[0].x); }
+    Row &operator [] (int i) { return row[i]; }
+    const Row &operator [] (int i) const { return row[i]; }
+    operator const T *() const { return static_cast<const T*>(&row[0].x); }
     // methods
-    mat4 operator * (float s) const { return mat4(s*row[0], s*row[1], s*row[2], s*row[3]); }
-    friend mat4 operator * (float s, const mat4 &m) { return m*s; }
-    mat4 operator * (const mat4 &m) const {
-        mat4 a(0);
-        for (int i = 0; i < 4; i++)
-            for (int j = 0; j < 4; j++)
-                for (int k = 0; k < 4; k++)
-                    a[i][j] += row[i][k]*m[k][j];
-        return a;
+    constexpr Mat operator * (T s) const {
+        Mat m(*this);
+        for (int i = 0; i < N; i++)
+            m.row[i] *= s;
+        return m;
     }
-    vec4 operator * (const vec4 &v) const { return vec4(dot(row[0], v), dot(row[1], v), dot(row[2], v), dot(row[3], v)); }
+    friend constexpr Mat operator * (T s, const Mat &m) { return m*s; }
+    Mat operator * (const Mat &m) const;
+    Row operator * (const Row &v) const;
 };
 
+typedef Mat<float, 3> mat3;             // (used by some quaternion related operations)
+typedef Mat<float, 4> mat4;
+typedef Mat<double, 3> dmat3;
+typedef Mat<double, 4> dmat4;
+
+template <class T, int N>
+inline Mat<T, N> Mat<T, N>::operator * (const Mat &m) const {
+    // row i of the product is the sum of the rows of m, weighted by row i of this
+    Mat r(0);
+    for (int i = 0; i < N; i++)
+        for (int k = 0; k < N; k++)
+            r.row[i] += row[i][k]*m.row[k];
+    return r;
+}
+
+template <class T, int N>
+inline Vec<T, N> Mat<T, N>::operator * (const Row &v) const {
+    Row r;
+    for (int i = 0; i < N; i++)
+        r[i] = dot(row[i], v);
+    return r;
+}
+
+// all are trivially copyable (so vectors of them move with memcpy and loops over them
+// vectorize) and tightly packed (so arrays of them can be passed directly to OpenGL)
+
+static_assert(std::is_trivially_copyable<vec2>::value && sizeof(vec2) == 2*sizeof(float), "vec2 layout");
+static_assert(std::is_trivially_copyable<vec3>::value && sizeof(vec3) == 3*sizeof(float), "vec3 layout");
+static_assert(std::is_trivially_copyable<vec4>::value && sizeof(vec4) == 4*sizeof(float), "vec4 layout");
+static_assert(std::is_trivially_copyable<mat3>::value && sizeof(mat3) == 9*sizeof(float), "mat3 layout");
+static_assert(std::is_trivially_copyable<mat4>::value && sizeof(mat4) == 16*sizeof(float), "mat4 layout");
+static_assert(std::is_standard_layout<vec3>::value && std::is_standard_layout<mat4>::value, "VecMat layout");
+static_assert(std::is_trivially_copyable<dmat4>::value && sizeof(dvec3) == 3*sizeof(double), "dvec3 layout");
+static_assert(std::is_trivially_copyable<vec3x8>::value && sizeof(vec3x8) == 3*sizeof(float8), "vec3x8 layout");
+
+// row i of a product is a weighted sum of the rows of the right-hand matrix, with
+// weights from row i of the left-hand; a, b, and r are row-major, four floats per row;
+// if affine, each has three rows (the bottom rows are taken to be (0,0,0,1), and are
+// neither read nor written), and each row takes three products
+
+inline void MultiplyRows(const float *pa, const float *pb, float *pr, bool affine) {
+    int nRows = affine? 3 : 4;
+#if defined(VECMAT_SSE)
+    __m128 b0 = _mm_loadu_ps(pb), b1 = _mm_loadu_ps(pb+4), b2 = _mm_loadu_ps(pb+8);
+    __m128 b3 = affine? _mm_setzero_ps() : _mm_loadu_ps(pb+12);
+    __m128 wMask = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+    for (int i = 0; i < nRows; i++) {
+        const float *w = pa+4*i;
+        __m128 s = _mm_mul_ps(_mm_set1_ps(w[0]), b0);
+        s = _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(w[1]), b1));
+        s = _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(w[2]), b2));
+        s = _mm_add_ps(s, affine? _mm_and_ps(_mm_loadu_ps(w), wMask) : _mm_mul_ps(_mm_set1_ps(w[3]), b3));
+        _mm_storeu_ps(pr+4*i, s);
+    }
+#elif defined(VECMAT_NEON)
+    float32x4_t b0 = vld1q_f32(pb), b1 = vld1q_f32(pb+4), b2 = vld1q_f32(pb+8);
+    float32x4_t b3 = affine? vdupq_n_f32(0) : vld1q_f32(pb+12);
+    for (int i = 0; i < nRows; i++) {
+        float32x4_t w = vld1q_f32(pa+4*i);
+        float32x4_t s = vmulq_lane_f32(b0, vget_low_f32(w), 0);
+        s = vmlaq_lane_f32(s, b1, vget_low_f32(w), 1);
+        s = vmlaq_lane_f32(s, b2, vget_high_f32(w), 0);
+        s = affine? vaddq_f32(s, vsetq_lane_f32(vgetq_lane_f32(w, 3), vdupq_n_f32(0), 3)) :
+                    vmlaq_lane_f32(s, b3, vget_high_f32(w), 1);
+        vst1q_f32(pr+4*i, s);
+    }
+#else
+    static const float unit[] = {0, 0, 0, 1};
+    const float *b3 = affine? unit : pb+12;
+    for (int i = 0; i < nRows; i++) {
+        const float *w = pa+4*i;
+        for (int j = 0; j < 4; j++)
+            pr[4*i+j] = w[0]*pb[j]+w[1]*pb[4+j]+w[2]*pb[8+j]+w[3]*b3[j];
+    }
+#endif
+}
+
+template <>
+inline mat4 mat4::operator * (const mat4 &m) const {
+    mat4 r(0);
+    MultiplyRows(*this, m, &r.row[0].x, false);
+    return r;
+}
+
+template <>
+inline vec4 mat4::operator * (const vec4 &v) const {
+    const float *p = *this;
+#if defined(VECMAT_SSE)
+    // products of rows with v, transposed so that summing the rows gives the four dots
+    __m128 vv = _mm_loadu_ps(&v.x);
+    __m128 r0 = _mm_mul_ps(_mm_loadu_ps(p), vv), r1 = _mm_mul_ps(_mm_loadu_ps(p+4), vv);
+    __m128 r2 = _mm_mul_ps(_mm_loadu_ps(p+8), vv), r3 = _mm_mul_ps(_mm_loadu_ps(p+12), vv);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    vec4 r;
+    _mm_storeu_ps(&r.x, _mm_add_ps(_mm_add_ps(r0, r1), _mm_add_ps(r2, r3)));
+    return r;
+#elif defined(VECMAT_NEON)
+    float32x4x4_t m = vld4q_f32(p);     // de-interleaved: m.val[j] holds column j
+    float32x4_t vv = vld1q_f32(&v.x);
+    float32x4_t s = vmulq_lane_f32(m.val[0], vget_low_f32(vv), 0);
+    s = vmlaq_lane_f32(s, m.val[1], vget_low_f32(vv), 1);
+    s = vmlaq_lane_f32(s, m.val[2], vget_high_f32(vv), 0);
+    s = vmlaq_lane_f32(s, m.val[3], vget_high_f32(vv), 1);
+    vec4 r;
+    vst1q_f32(&r.x, s);
+    return r;
+#else
+    return vec4(dot(row[0], v), dot(row[1], v), dot(row[2], v), dot(row[3], v));
+#endif
+}
+
+inline mat4 MultiplyAffine(const mat4 &a, const mat4 &b) {
+    // a*b, assuming both bottom rows are (0,0,0,1), as for rotations, translations,
+    // scales, and their products; skips the bottom row
+    mat4 r;                             // bottom row (0,0,0,1) is kept
+    MultiplyRows(a, b, &r.row[0].x, true);
+    return r;
+}
+
 inline mat4 Scale(float x, float y, float z) {
     mat4 c;
     c[0][0] = x;
@@ -320,6 +501,54 @@ inline mat4 LookAt(const vec3 &eye, const vec3 &lookat, const vec3 &up) {
     return m*Translate(-eye);
 }
 
+template <class T>
+inline Mat<T, 4> Inverse(const Mat<T, 4> &m, bool *invertible = NULL) {
+    // general inverse, by cofactors; if m is singular, return identity (and set *invertible false)
+    const T *a = m;
+    T c[16];
+    c[0]  =  a[5]*a[10]*a[15]-a[5]*a[11]*a[14]-a[9]*a[6]*a[15]+a[9]*a[7]*a[14]+a[13]*a[6]*a[11]-a[13]*a[7]*a[10];
+    c[4]  = -a[4]*a[10]*a[15]+a[4]*a[11]*a[14]+a[8]*a[6]*a[15]-a[8]*a[7]*a[14]-a[12]*a[6]*a[11]+a[12]*a[7]*a[10];
+    c[8]  =  a[4]*a[9]*a[15]-a[4]*a[11]*a[13]-a[8]*a[5]*a[15]+a[8]*a[7]*a[13]+a[12]*a[5]*a[11]-a[12]*a[7]*a[9];
+    c[12] = -a[4]*a[9]*a[14]+a[4]*a[10]*a[13]+a[8]*a[5]*a[14]-a[8]*a[6]*a[13]-a[12]*a[5]*a[10]+a[12]*a[6]*a[9];
+    T det = a[0]*c[0]+a[1]*c[4]+a[2]*c[8]+a[3]*c[12];
+    if (invertible)
+        *invertible = det != 0;
+    if (det == 0)
+        return Mat<T, 4>();
+    c[1]  = -a[1]*a[10]*a[15]+a[1]*a[11]*a[14]+a[9]*a[2]*a[15]-a[9]*a[3]*a[14]-a[13]*a[2]*a[11]+a[13]*a[3]*a[10];
+    c[5]  =  a[0]*a[10]*a[15]-a[0]*a[11]*a[14]-a[8]*a[2]*a[15]+a[8]*a[3]*a[14]+a[12]*a[2]*a[11]-a[12]*a[3]*a[10];
+    c[9]  = -a[0]*a[9]*a[15]+a[0]*a[11]*a[13]+a[8]*a[1]*a[15]-a[8]*a[3]*a[13]-a[12]*a[1]*a[11]+a[12]*a[3]*a[9];
+    c[13] =  a[0]*a[9]*a[14]-a[0]*a[10]*a[13]-a[8]*a[1]*a[14]+a[8]*a[2]*a[13]+a[12]*a[1]*a[10]-a[12]*a[2]*a[9];
+    c[2]  =  a[1]*a[6]*a[15]-a[1]*a[7]*a[14]-a[5]*a[2]*a[15]+a[5]*a[3]*a[14]+a[13]*a[2]*a[7]-a[13]*a[3]*a[6];
+    c[6]  = -a[0]*a[6]*a[15]+a[0]*a[7]*a[14]+a[4]*a[2]*a[15]-a[4]*a[3]*a[14]-a[12]*a[2]*a[7]+a[12]*a[3]*a[6];
+    c[10] =  a[0]*a[5]*a[15]-a[0]*a[7]*a[13]-a[4]*a[1]*a[15]+a[4]*a[3]*a[13]+a[12]*a[1]*a[7]-a[12]*a[3]*a[5];
+    c[14] = -a[0]*a[5]*a[14]+a[0]*a[6]*a[13]+a[4]*a[1]*a[14]-a[4]*a[2]*a[13]-a[12]*a[1]*a[6]+a[12]*a[2]*a[5];
+    c[3]  = -a[1]*a[6]*a[11]+a[1]*a[7]*a[10]+a[5]*a[2]*a[11]-a[5]*a[3]*a[10]-a[9]*a[2]*a[7]+a[9]*a[3]*a[6];
+    c[7]  =  a[0]*a[6]*a[11]-a[0]*a[7]*a[10]-a[4]*a[2]*a[11]+a[4]*a[3]*a[10]+a[8]*a[2]*a[7]-a[8]*a[3]*a[6];
+    c[11] = -a[0]*a[5]*a[11]+a[0]*a[7]*a[9]+a[4]*a[1]*a[11]-a[4]*a[3]*a[9]-a[8]*a[1]*a[7]+a[8]*a[3]*a[5];
+    c[15] =  a[0]*a[5]*a[10]-a[0]*a[6]*a[9]-a[4]*a[1]*a[10]+a[4]*a[2]*a[9]+a[8]*a[1]*a[6]-a[8]*a[2]*a[5];
+    T r = 1/det;
+    return Mat<T, 4>(Vec<T, 4>(c[0]*r, c[1]*r, c[2]*r, c[3]*r), Vec<T, 4>(c[4]*r, c[5]*r, c[6]*r, c[7]*r),
+                     Vec<T, 4>(c[8]*r, c[9]*r, c[10]*r, c[11]*r), Vec<T, 4>(c[12]*r, c[13]*r, c[14]*r, c[15]*r));
+}
+
+template <class T>
+inline Mat<T, 4> InverseAffine(const Mat<T, 4> &m, bool *invertible = NULL) {
+    // inverse of m with bottom row (0,0,0,1): invert upper-left 3x3, then negate
+    // the translation and take it through that inverse
+    Vec<T, 3> r0(m[0][0], m[0][1], m[0][2]), r1(m[1][0], m[1][1], m[1][2]), r2(m[2][0], m[2][1], m[2][2]);
+    Vec<T, 3> c0 = cross(r1, r2), c1 = cross(r2, r0), c2 = cross(r0, r1);    // columns of adjugate
+    T det = dot(r0, c0);
+    if (invertible)
+        *invertible = det != 0;
+    if (det == 0)
+        return Mat<T, 4>();
+    T s = 1/det;
+    Vec<T, 3> i0 = s*Vec<T, 3>(c0.x, c1.x, c2.x), i1 = s*Vec<T, 3>(c0.y, c1.y, c2.y), i2 = s*Vec<T, 3>(c0.z, c1.z, c2.z);
+    Vec<T, 3> t(m[0][3], m[1][3], m[2][3]);
+    return Mat<T, 4>(Vec<T, 4>(i0, -dot(i0, t)), Vec<T, 4>(i1, -dot(i1, t)), Vec<T, 4>(i2, -dot(i2, t)), Vec<T, 4>(0, 0, 0, 1));
+}
+
 inline mat4 Transpose(mat4 &m) {
     return mat4(vec4(m[0][0], m[1][0], m[2][0], m[3][0]),
                 vec4(m[0][1], m[1][1], m[2][1], m[3][1]),
@@ -32,6 +32,7 @@ private:
     vec3 *point = NULL;
     float plane[4] = {0, 0, 0, 0}; // unnormalized
     vec2  mouseOffset;
+    int   viewport[4] = {0, 0, 1, 1}; // as of Down
 friend class Framer;
 };
 
@@ -55,6 +56,7 @@ private:
     vec3 color;
     JoyType mode = JoyType::A_None;
     float plane[4] = {0, 0, 0, 0};
+    int viewport[4] = {0, 0, 1, 1};     // as of Down
     bool fwdFace = true;
     bool  hit = false;
 };
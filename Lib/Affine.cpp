@@ -0,0 +1,53 @@
+// Affine.cpp - affine transformations as 3x4 matrices, and in decomposed (TRS) form
+
+#include "Affine.h"
+
+mat3x4 InverseAffine(const mat3x4 &m, bool *invertible) {
+    return mat3x4(InverseAffine(mat4(m), invertible));
+}
+
+mat3 NormalMatrix(const mat3x4 &m) {
+    // rows of the inverse transpose are the columns of the inverse: the cofactors, over det
+    vec3 r0(m[0][0], m[0][1], m[0][2]), r1(m[1][0], m[1][1], m[1][2]), r2(m[2][0], m[2][1], m[2][2]);
+    vec3 c0 = cross(r1, r2), c1 = cross(r2, r0), c2 = cross(r0, r1);
+    float det = dot(r0, c0);
+    if (det == 0)
+        return mat3();
+    float s = 1/det;
+    return mat3(s*c0, s*c1, s*c2);
+}
+
+mat3x4 RotateXYZ(const vec3 &degrees) {
+    vec3 a = DegreesToRadians*degrees;
+    float cx = cos(a.x), sx = sin(a.x), cy = cos(a.y), sy = sin(a.y), cz = cos(a.z), sz = sin(a.z);
+    return mat3x4(vec4(cy*cz,          -cy*sz,          sy,     0),
+                  vec4(sx*sy*cz+cx*sz, cx*cz-sx*sy*sz,  -sx*cy, 0),
+                  vec4(sx*sz-cx*sy*cz, cx*sy*sz+sx*cz,  cx*cy,  0));
+}
+
+// TRS
+
+TRS::TRS(const mat3x4 &m) {
+    vec3 c[3];                          // columns of the left 3x3
+    for (int k = 0; k < 3; k++) {
+        c[k] = vec3(m[0][k], m[1][k], m[2][k]);
+        s[k] = length(c[k]);
+        if (s[k] > 0)
+            c[k] /= s[k];
+    }
+    mat3 rot(vec3(c[0].x, c[1].x, c[2].x), vec3(c[0].y, c[1].y, c[2].y), vec3(c[0].z, c[1].z, c[2].z));
+    r = Quaternion(rot);
+    t = m.Translation();
+}
+
+mat3x4 TRS::Matrix() const {
+    // rotation from the quaternion (as Quaternion::Get3x3, transposed), columns scaled
+    float n = r.x*r.x+r.y*r.y+r.z*r.z+r.w*r.w, f = n > 0? 2/n : 0;
+    float xs = r.x*f,   ys = r.y*f,   zs = r.z*f;
+    float wx = r.w*xs,  wy = r.w*ys,  wz = r.w*zs;
+    float xx = r.x*xs,  xy = r.x*ys,  xz = r.x*zs;
+    float yy = r.y*ys,  yz = r.y*zs,  zz = r.z*zs;
+    return mat3x4(vec4(s.x*(1-(yy+zz)), s.y*(xy-wz),      s.z*(xz+wy),      t.x),
+                  vec4(s.x*(xy+wz),     s.y*(1-(xx+zz)),  s.z*(yz-wx),      t.y),
+                  vec4(s.x*(xz-wy),     s.y*(yz+wx),      s.z*(1-(xx+yy)),  t.z));
+}
@@ -0,0 +1,225 @@
+// BlobField.cpp - sum of Wyvill blobs, binned in a uniform grid for fast evaluation
+
+#include <math.h>
+#include <float.h>
+#include "BlobField.h"
+#include "PolygonizerT.h"
+
+// Polygonize's coarse seeding uses the batched Evaluate for the documented std::cref(blobs)
+static_assert(PolygonizerDetail::HasEvaluateBatch<std::reference_wrapper<const BlobField> >::value, "BlobField batched Evaluate");
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BLOB_SSE
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Wyvill kernel as a cubic in t = x^2 (see FilterWyvill::Function), and its derivative in t
+const float K3 = -4.f/9.f, K2 = 17.f/9.f, K1 = -22.f/9.f;
+
+inline float Wyvill(float t) { return ((K3*t+K2)*t+K1)*t+1; }
+inline float dWyvill(float t) { return (3*K3*t+2*K2)*t+K1; }
+
+const int MAXCELLS = 1<<21;     // grid resolution limit
+
+inline int Clamp(int i, int lo, int hi) { return i < lo? lo : i > hi? hi : i; }
+
+} // end namespace
+
+void BlobField::Add(const vec3 &center, float radius, float weight) {
+    Blob b = {center, radius, weight};
+    blobs.push_back(b);
+}
+
+void BlobField::Clear() {
+    blobs.resize(0);
+    cellStart.resize(0);
+    cx.resize(0); cy.resize(0); cz.resize(0); invR2.resize(0); w.resize(0);
+}
+
+std::vector<vec3> BlobField::Centers() {
+    std::vector<vec3> centers(blobs.size());
+    for (size_t i = 0; i < blobs.size(); i++)
+        centers[i] = blobs[i].center;
+    return centers;
+}
+
+bool BlobField::Bounds(vec3 &bMin, vec3 &bMax) const {
+    if (!blobs.size())
+        return false;
+    bMin = vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+    bMax = -bMin;
+    for (size_t i = 0; i < blobs.size(); i++) {
+        const Blob &b = blobs[i];
+        for (int k = 0; k < 3; k++) {
+            bMin[k] = fminf(bMin[k], b.center[k]-b.radius);
+            bMax[k] = fmaxf(bMax[k], b.center[k]+b.radius);
+        }
+    }
+    return true;
+}
+
+void BlobField::Build() {
+    cellStart.resize(0);
+    cx.resize(0); cy.resize(0); cz.resize(0); invR2.resize(0); w.resize(0);
+    vec3 bMax;
+    if (!Bounds(min, bMax))
+        return;
+    // cells at least a blob diameter wide, so each blob is binned into at most eight cells
+    float maxRadius = 0;
+    for (size_t i = 0; i < blobs.size(); i++)
+        maxRadius = fmaxf(maxRadius, blobs[i].radius);
+    vec3 extent = bMax-min;
+    cellSize = 2*maxRadius;
+    for (;;) {
+        res = int3((int) ceil(extent.x/cellSize), (int) ceil(extent.y/cellSize), (int) ceil(extent.z/cellSize));
+        for (int k = 0; k < 3; k++)
+            res[k] = res[k] < 1? 1 : res[k];
+        if ((double) res.i1*res.i2*res.i3 <= MAXCELLS)
+            break;
+        cellSize *= 1.25f;
+    }
+    invCellSize = 1/cellSize;
+    int nCells = res.i1*res.i2*res.i3;
+    // count blobs per cell, pad to multiple of four
+    std::vector<int3> lo(blobs.size()), hi(blobs.size());
+    std::vector<int> counts(nCells, 0);
+    for (size_t i = 0; i < blobs.size(); i++) {
+        const Blob &b = blobs[i];
+        for (int k = 0; k < 3; k++) {
+            lo[i][k] = Clamp((int) floor((b.center[k]-b.radius-min[k])*invCellSize), 0, res[k]-1);
+            hi[i][k] = Clamp((int) floor((b.center[k]+b.radius-min[k])*invCellSize), 0, res[k]-1);
+        }
+        for (int x = lo[i].i1; x <= hi[i].i1; x++)
+            for (int y = lo[i].i2; y <= hi[i].i2; y++)
+                for (int z = lo[i].i3; z <= hi[i].i3; z++)
+                    counts[(x*res.i2+y)*res.i3+z]++;
+    }
+    cellStart.resize(nCells+1);
+    cellStart[0] = 0;
+    for (int c = 0; c < nCells; c++)
+        cellStart[c+1] = cellStart[c]+((counts[c]+3)&~3);
+    // fill coefficients; padding has zero weight
+    int total = cellStart[nCells];
+    cx.assign(total, 0); cy.assign(total, 0); cz.assign(total, 0); invR2.assign(total, 0); w.assign(total, 0);
+    for (int c = 0; c < nCells; c++)
+        counts[c] = cellStart[c];
+    for (size_t i = 0; i < blobs.size(); i++) {
+        const Blob &b = blobs[i];
+        for (int x = lo[i].i1; x <= hi[i].i1; x++)
+            for (int y = lo[i].i2; y <= hi[i].i2; y++)
+                for (int z = lo[i].i3; z <= hi[i].i3; z++) {
+                    int n = counts[(x*res.i2+y)*res.i3+z]++;
+                    cx[n] = b.center.x;
+                    cy[n] = b.center.y;
+                    cz[n] = b.center.z;
+                    invR2[n] = 1/(b.radius*b.radius);
+                    w[n] = b.weight;
+                }
+    }
+}
+
+int BlobField::CellIndex(const vec3 &p) const {
+    if (!cellStart.size())
+        return -1;
+    int x = (int) floor((p.x-min.x)*invCellSize);
+    int y = (int) floor((p.y-min.y)*invCellSize);
+    int z = (int) floor((p.z-min.z)*invCellSize);
+    if (x < 0 || y < 0 || z < 0 || x >= res.i1 || y >= res.i2 || z >= res.i3)
+        return -1;
+    return (x*res.i2+y)*res.i3+z;
+}
+
+float BlobField::SumCell(int cell, const vec3 &p) const {
+    int b = cellStart[cell], e = cellStart[cell+1];
+#ifdef BLOB_SSE
+    __m128 px = _mm_set1_ps(p.x), py = _mm_set1_ps(p.y), pz = _mm_set1_ps(p.z);
+    __m128 one = _mm_set1_ps(1), k3 = _mm_set1_ps(K3), k2 = _mm_set1_ps(K2), k1 = _mm_set1_ps(K1);
+    __m128 sum = _mm_setzero_ps();
+    for (int i = b; i < e; i += 4) {
+        __m128 dx = _mm_sub_ps(px, _mm_loadu_ps(&cx[i]));
+        __m128 dy = _mm_sub_ps(py, _mm_loadu_ps(&cy[i]));
+        __m128 dz = _mm_sub_ps(pz, _mm_loadu_ps(&cz[i]));
+        __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        __m128 t = _mm_mul_ps(d2, _mm_loadu_ps(&invR2[i]));
+        __m128 f = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(k3, t), k2), t), k1), t), one);
+        __m128 inside = _mm_cmplt_ps(t, one);
+        sum = _mm_add_ps(sum, _mm_and_ps(inside, _mm_mul_ps(f, _mm_loadu_ps(&w[i]))));
+    }
+    float s[4];
+    _mm_storeu_ps(s, sum);
+    return (s[0]+s[1])+(s[2]+s[3]);
+#else
+    float sum = 0;
+    for (int i = b; i < e; i++) {
+        float dx = p.x-cx[i], dy = p.y-cy[i], dz = p.z-cz[i];
+        float t = (dx*dx+dy*dy+dz*dz)*invR2[i];
+        sum += t < 1? w[i]*Wyvill(t) : 0;
+    }
+    return sum;
+#endif
+}
+
+float BlobField::Evaluate(const vec3 &p) const {
+    int cell = CellIndex(p);
+    return (cell < 0? 0 : SumCell(cell, p))-threshold;
+}
+
+float BlobField::Evaluate(const vec3 &p, vec3 &gradient) const {
+    gradient = vec3(0, 0, 0);
+    int cell = CellIndex(p);
+    if (cell < 0)
+        return -threshold;
+    float sum = 0;
+    for (int i = cellStart[cell]; i < cellStart[cell+1]; i++) {
+        float dx = p.x-cx[i], dy = p.y-cy[i], dz = p.z-cz[i];
+        float t = (dx*dx+dy*dy+dz*dz)*invR2[i];
+        if (t < 1) {
+            sum += w[i]*Wyvill(t);
+            float d = 2*w[i]*invR2[i]*dWyvill(t);   // d/dp of w*Wyvill(|p-c|^2/r^2)
+            gradient.x += d*dx;
+            gradient.y += d*dy;
+            gradient.z += d*dz;
+        }
+    }
+    return sum-threshold;
+}
+
+void BlobField::Evaluate(const vec3 *points, float *values, int n) const {
+    // successive points in the same cell are evaluated four at a time, sharing coefficient loads
+    for (int i = 0; i < n; ) {
+        int cell = CellIndex(points[i]), count = 1;
+        if (cell < 0) {
+            values[i++] = -threshold;
+            continue;
+        }
+        while (i+count < n && count < 4 && CellIndex(points[i+count]) == cell)
+            count++;
+#ifdef BLOB_SSE
+        if (count == 4) {
+            const vec3 *p = points+i;
+            __m128 px = _mm_setr_ps(p[0].x, p[1].x, p[2].x, p[3].x);
+            __m128 py = _mm_setr_ps(p[0].y, p[1].y, p[2].y, p[3].y);
+            __m128 pz = _mm_setr_ps(p[0].z, p[1].z, p[2].z, p[3].z);
+            __m128 one = _mm_set1_ps(1), k3 = _mm_set1_ps(K3), k2 = _mm_set1_ps(K2), k1 = _mm_set1_ps(K1);
+            __m128 sum = _mm_setzero_ps();
+            for (int b = cellStart[cell]; b < cellStart[cell+1]; b++) {
+                __m128 dx = _mm_sub_ps(px, _mm_set1_ps(cx[b]));
+                __m128 dy = _mm_sub_ps(py, _mm_set1_ps(cy[b]));
+                __m128 dz = _mm_sub_ps(pz, _mm_set1_ps(cz[b]));
+                __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                __m128 t = _mm_mul_ps(d2, _mm_set1_ps(invR2[b]));
+                __m128 f = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(k3, t), k2), t), k1), t), one);
+                __m128 inside = _mm_cmplt_ps(t, one);
+                sum = _mm_add_ps(sum, _mm_and_ps(inside, _mm_mul_ps(f, _mm_set1_ps(w[b]))));
+            }
+            _mm_storeu_ps(values+i, _mm_sub_ps(sum, _mm_set1_ps(threshold)));
+            i += 4;
+            continue;
+        }
+#endif
+        for (int k = 0; k < count; k++, i++)
+            values[i] = SumCell(cell, points[i])-threshold;
+    }
+}
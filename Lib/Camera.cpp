@@ -2,27 +2,55 @@
 
 #include "Camera.h"
 #include <stdio.h>
+#include <string.h>
+#include "Affine.h"
 
 Camera::Camera(float aspectRatio, vec3 rot, vec3 tran, float fov, float nearDist, float farDist, bool invVrt) :
     aspectRatio(aspectRatio), rot(rot), tran(tran), fov(fov),
     nearDist(nearDist), farDist(farDist), invertVertical(invVrt) {
-        persp = Perspective(fov, aspectRatio, nearDist, farDist);
-        modelview = Translate(tran)*GetRotate();
-        fullview = persp*modelview;
+        SetMatrices(Translate(tran)*GetRotate(), true);
 };
 
 Camera::Camera(int scrnW, int scrnH, vec3 rot, vec3 tran, float fov, float nearDist, float farDist, bool invVrt) :
     aspectRatio((float) scrnW/scrnH), rot(rot), tran(tran), fov(fov),
     nearDist(nearDist), farDist(farDist), invertVertical(invVrt) {
-        persp = Perspective(fov, aspectRatio, nearDist, farDist);
-        modelview = Translate(tran)*GetRotate();
-        fullview = persp*modelview;
+        SetMatrices(Translate(tran)*GetRotate(), true);
 };
 
+// Matrices
+
+void Camera::SetMatrices(const mat4 &mv, bool perspective) {
+    // set modelview (and, if perspective, persp) and fullview; a new version only if changed
+    mat4 p = perspective? Perspective(fov, aspectRatio, nearDist, farDist) : persp;
+    if (!memcmp(&mv, &modelview, sizeof(mat4)) && !memcmp(&p, &persp, sizeof(mat4)))
+        return;
+    modelview = mv;
+    persp = p;
+    fullview = persp*modelview;
+    version++;
+}
+
+void Camera::UpdateCache() const {
+    if (cached != version) {
+        inverse = InverseAffine(mat3x4(modelview));
+        normal = NormalMatrix(mat3x4(modelview));
+        cached = version;
+    }
+}
+
+const mat4 &Camera::GetInverse() const {
+    UpdateCache();
+    return inverse;
+}
+
+const mat3 &Camera::GetNormal() const {
+    UpdateCache();
+    return normal;
+}
+
 void Camera::SetFOV(float newFOV) {
     fov = newFOV;
-    persp = Perspective(fov, aspectRatio, nearDist, farDist);
-    fullview = persp*modelview;
+    SetMatrices(modelview, true);
 }
 
 float Camera::GetFOV() {
@@ -31,8 +59,7 @@ float Camera::GetFOV() {
 
 void Camera::Resize(int screenW, int screenH) {
     aspectRatio = (float)screenW/screenH;
-    persp = Perspective(fov, aspectRatio, nearDist, farDist);
-    fullview = persp*modelview;
+    SetMatrices(modelview, true);
 }
 
 void Camera::SetSpeed(float rotS, float tranS) {
@@ -41,12 +68,10 @@ void Camera::SetSpeed(float rotS, float tranS) {
 }
 
 mat4 Camera::GetRotate() {
-    mat4 moveToCenter = Translate(-rotateCenter);
-    mat4 moveBack = Translate(rotateCenter+rotateOffset);
-    mat4 rx = RotateX(rot[0]);
-    mat4 ry = RotateY(rot[1]);
-    mat4 rz = RotateZ(rot[2]);
-    return moveBack*rx*ry*rz*moveToCenter;
+    // Translate(rotateCenter+rotateOffset)*RotateX*RotateY*RotateZ*Translate(-rotateCenter)
+    mat3x4 r = RotateXYZ(rot);
+    r.SetTranslation(rotateCenter+rotateOffset-r.Vector(rotateCenter));
+    return r;
 }
 
 void Camera::SetRotateCenter(vec3 r) {
@@ -72,8 +97,7 @@ void Camera::MouseDrag(double x, double y, bool shift) {
         rot.x = rotOld.x+rotSpeed*dif.y;
         rot.y = rotOld.y+rotSpeed*dif.x;
     }
-    modelview = Translate(tran)*GetRotate();
-    fullview = persp*modelview;
+    SetMatrices(Translate(tran)*GetRotate());
 }
 
 void Camera::MouseWheel(bool forward, bool shift) {
@@ -81,8 +105,7 @@ void Camera::MouseWheel(bool forward, bool shift) {
         tranOld.z = (tran.z += forward? -.1f : .1f);  // dolly in/out
     else
         rotOld.z = (rot.z += 5*(forward? rotSpeed : -rotSpeed));
-    modelview = Translate(tran)*GetRotate();
-    fullview = persp*modelview;
+    SetMatrices(Translate(tran)*GetRotate());
 }
 
 void Camera::MouseUp() {
@@ -2,6 +2,8 @@
 
 #include "CameraArcball.h"
 #include <stdio.h>
+#include <string.h>
+#include "Affine.h"
 
 // ? Do not pass the window size to glViewport or other pixel-based OpenGL calls.
 // ? The window size is in screen coordinates, not pixels.
@@ -28,11 +30,8 @@ bool CameraAB::Read(const char *filename) {
         fread(&nearDist, sizeof(float), 1, in) == 1 &&
         fread(&farDist, sizeof(float), 1, in) == 1;
     fclose(in);
-    if (ok) {
-        persp = Perspective(fov, aspectRatio, nearDist, farDist);
-        modelview = Translate(tran)*rot;
-        fullview = persp*modelview;
-    }
+    if (ok)
+        SetMatrices(Translate(tran)*rot, true);
     return ok;
 }
 
@@ -40,9 +39,7 @@ void CameraAB::Set(int *vp) { Set(vp[0], vp[1], vp[2], vp[3]); }
 
 void CameraAB::Set(int scrnX, int scrnY, int scrnW, int scrnH) {
     aspectRatio = (float) scrnW / scrnH;
-    persp = Perspective(fov, aspectRatio, nearDist, farDist);
-    modelview = Translate(tran)*rot;
-    fullview = persp*modelview;
+    SetMatrices(Translate(tran)*rot, true);
     float minS = (float) (scrnW < scrnH? scrnW : scrnH);
     arcball.Set(&this->rot, vec2((float) (scrnX+scrnW/2), (float) (scrnY+scrnH/2)), minS/2-50);
 };
@@ -56,9 +53,7 @@ void CameraAB::Set(int scrnX, int scrnY, int scrnW, int scrnH, mat4 rot, vec3 tr
     this->farDist = farDist;
     this->invertVertical = invVrt;
     tranSpeed = .01f;
-    persp = Perspective(fov, aspectRatio, nearDist, farDist);
-    modelview = Translate(tran)*rot;
-    fullview = persp*modelview;
+    SetMatrices(Translate(tran)*rot, true);
     float minS = (float) (scrnW < scrnH? scrnW : scrnH);
     arcball.Set(&this->rot, vec2((float) (scrnX+scrnW/2), (float) (scrnY+scrnH/2)), minS/2-50);
 };
@@ -73,12 +68,12 @@ void CameraAB::Set(int scrnX, int scrnY, int scrnW, int scrnH, Quaternion qrot,
 }
 
 CameraAB::CameraAB(int *viewport, vec3 eulerAngs, vec3 tran, float fov, float nearDist, float farDist, bool invVrt) {
-    rot = RotateX(eulerAngs[0])*RotateY(eulerAngs[1])*RotateZ(eulerAngs[2]);
+    rot = RotateXYZ(eulerAngs);
     Set(viewport, rot, tran, fov, nearDist, farDist, invVrt);
 };
 
 CameraAB::CameraAB(int scrnX, int scrnY, int scrnW, int scrnH, vec3 eulerAngs, vec3 tran, float fov, float nearDist, float farDist, bool invVrt) {
-    rot = RotateX(eulerAngs[0])*RotateY(eulerAngs[1])*RotateZ(eulerAngs[2]);
+    rot = RotateXYZ(eulerAngs);
     Set(scrnX, scrnY, scrnW, scrnH, rot, tran, fov, nearDist, farDist, invVrt);
 };
 
@@ -89,32 +84,62 @@ CameraAB::CameraAB(int scrnX, int scrnY, int scrnW, int scrnH, Quaternion qrot,
 
 void CameraAB::SetModelview(mat4 mv) {
     tranOld = tran = vec3(mv[0][3], mv[1][3], mv[2][3]);    // FrameBase(mv);
-    rot = modelview = mv;
+    rot = mv;
     rot[0][3] = rot[1][3] = rot[2][3] = 0;                  // remove tran from rot
+    SetMatrices(mv);
+}
+
+// Matrices
+
+void CameraAB::SetMatrices(const mat4 &mv, bool perspective) {
+    // set modelview (and, if perspective, persp) and fullview; a new version only if changed
+    mat4 p = perspective? Perspective(fov, aspectRatio, nearDist, farDist) : persp;
+    if (!memcmp(&mv, &modelview, sizeof(mat4)) && !memcmp(&p, &persp, sizeof(mat4)))
+        return;
+    modelview = mv;
+    persp = p;
     fullview = persp*modelview;
+    version++;
+}
+
+void CameraAB::UpdateCache() const {
+    if (cached != version) {
+        inverse = InverseAffine(mat3x4(modelview));
+        normal = NormalMatrix(mat3x4(modelview));
+        cached = version;
+    }
+}
+
+const mat4 &CameraAB::GetInverse() const {
+    UpdateCache();
+    return inverse;
+}
+
+const mat3 &CameraAB::GetNormal() const {
+    UpdateCache();
+    return normal;
 }
 
 void CameraAB::SetFOV(float newFOV) {
     fov = newFOV;
-    persp = Perspective(fov, aspectRatio, nearDist, farDist);
-    fullview = persp*modelview;
+    SetMatrices(modelview, true);
 }
 
 float CameraAB::GetFOV() { return fov; }
 
 void CameraAB::Resize(int width, int height) {
     aspectRatio = (float) width/height;
-    persp = Perspective(fov, aspectRatio, nearDist, farDist);
-    fullview = persp*modelview;
+    SetMatrices(modelview, true);
     arcball.Set(&rot, vec2((float) width, (float) height)/2, (float) (width < height? width : height)/2-50);
 }
 
 void CameraAB::SetSpeed(float tranS) { tranSpeed = tranS; }
 
 mat4 CameraAB::GetRotate() {
-    mat4 moveToCenter = Translate(-rotateCenter);
-    mat4 moveBack = Translate(rotateCenter+rotateOffset);
-    return moveBack*rot*moveToCenter;
+    // Translate(rotateCenter+rotateOffset)*rot*Translate(-rotateCenter)
+    mat3x4 r(rot);
+    r.SetTranslation(rotateCenter+rotateOffset-r.Vector(rotateCenter));
+    return r;
 }
 
 void CameraAB::SetRotateCenter(vec3 r) {
@@ -148,8 +173,7 @@ void CameraAB::MouseDrag(int x, int y, bool shift) {
         tran = tranOld+tranSpeed*vec3(dif.x, -dif.y, 0);
     else
         arcball.Drag(x, y);
-    modelview = Translate(tran)*GetRotate();
-    fullview = persp*modelview;
+    SetMatrices(Translate(tran)*GetRotate());
 }
 
 void CameraAB::MouseWheel(bool forward, bool shift) {
@@ -157,8 +181,7 @@ void CameraAB::MouseWheel(bool forward, bool shift) {
         tranOld.z = (tran.z += forward? -.1f : .1f);  // dolly in/out
 //  else
 //      arcball.Wheel(direction, shift); // **** causes mouse-down jump
-    modelview = Translate(tran)*GetRotate();
-    fullview = persp*modelview;
+    SetMatrices(Translate(tran)*GetRotate());
 }
 
 void CameraAB::MouseUp() {
@@ -1,13 +1,14 @@
 // Draw.cpp - various draw operations
 
 #include <glad.h>
-#include <gl/glu.h>
 #include "Draw.h"
 #include "GLXtras.h"
 #include "Misc.h"
+#include "Transform.h"
 #include <float.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <vector>
 
 // Screen Mode
@@ -76,48 +77,57 @@ float ScreenDistSq(double x, double y, vec3 p, mat4 m, float *zscreen) {
     return static_cast<float>(dx*dx+dy*dy);
 }
 
-void ScreenRay(float xscreen, float yscreen, mat4 modelview, mat4 persp, vec3 &p, vec3 &v) {
-    // compute ray from p in direction v; p is transformed eyepoint, xscreen, yscreen determine v
-    int vp[4];
+namespace {
+
+struct UnprojectCache {
+    // inverse of persp*modelview, recomputed only when the camera changes
+    mat4 modelview, persp, inverse;
+    bool valid = false;
+    const mat4 &Inverse(const mat4 &m, const mat4 &p) {
+        if (!valid || memcmp(&m, &modelview, sizeof(mat4)) || memcmp(&p, &persp, sizeof(mat4))) {
+            modelview = m;
+            persp = p;
+            inverse = ::Inverse(p*m);
+            valid = true;
+        }
+        return inverse;
+    }
+} unprojectCache;
+
+const int *Viewport(const int *viewport, int *vp) {
+    // viewport if given, else the GL viewport, queried into vp (a resize or another view
+    // may change it without changing the matrices)
+    if (viewport)
+        return viewport;
     glGetIntegerv(GL_VIEWPORT, vp);
+    return vp;
+}
+
+} // end namespace
+
+void ScreenRay(float xscreen, float yscreen, mat4 modelview, mat4 persp, vec3 &p, vec3 &v, const int *viewport) {
+    // compute ray from p in direction v; p is transformed eyepoint, xscreen, yscreen determine v
+    int buffer[4];
+    const int *vp = Viewport(viewport, buffer);
+    const mat4 &inv = unprojectCache.Inverse(modelview, persp);
     // origin of ray is always eye (translated origin)
     p = vec3(modelview[0][3], modelview[1][3], modelview[2][3]);
-    // create transposes for gluUnproject
-    double tpersp[4][4], tmodelview[4][4], a[3], b[3];
-    for (int i = 0; i < 4; i++)
-        for (int j = 0; j < 4; j++) {
-            tmodelview[i][j] = modelview[j][i];
-            tpersp[i][j] = persp[j][i];
-        }
     // un-project two screen points of differing depth to determine v
-    if (gluUnProject(xscreen, yscreen, .25, (const double*) tmodelview, (const double*) tpersp, vp, &a[0], &a[1], &a[2]) == GL_FALSE)
-        printf("UnProject false\n");
-    if (gluUnProject(xscreen, yscreen, .50, (const double*) tmodelview, (const double*) tpersp, vp, &b[0], &b[1], &b[2]) == GL_FALSE)
-        printf("UnProject false\n");
-    v = normalize(vec3((float) (b[0]-a[0]), (float) (b[1]-a[1]), (float) (b[2]-a[2])));
+    vec3 a = Unproject(vec3(xscreen, yscreen, .25f), inv, vp);
+    vec3 b = Unproject(vec3(xscreen, yscreen, .50f), inv, vp);
+    v = normalize(b-a);
 }
 
-void ScreenLine(float xscreen, float yscreen, mat4 modelview, mat4 persp, vec3 &p1, vec3 &p2) {
+void ScreenLine(float xscreen, float yscreen, mat4 modelview, mat4 persp, vec3 &p1, vec3 &p2, const int *viewport) {
     // compute 3D world space line, given by p1 and p2, that transforms
     // to a line perpendicular to the screen at (xscreen, yscreen)
-    double tpersp[4][4], tmodelview[4][4], a[3], b[3];
-    // get viewport
-    int vp[4];
-    glGetIntegerv(GL_VIEWPORT, vp);
-    // create transposes
-    for (int i = 0; i < 4; i++)
-        for (int j = 0; j < 4; j++) {
-            tmodelview[i][j] = modelview[j][i];
-            tpersp[i][j] = persp[j][i];
-        }
-    if (gluUnProject(xscreen, yscreen, .25, (const double*) tmodelview, (const double*) tpersp, vp, &a[0], &a[1], &a[2]) == GL_FALSE)
-        printf("UnProject false\n");
-    if (gluUnProject(xscreen, yscreen, .50, (const double*) tmodelview, (const double*) tpersp, vp, &b[0], &b[1], &b[2]) == GL_FALSE)
-        printf("UnProject false\n");
-        // alternatively, a seond point can be determined by transforming the origin by the inverse of modelview
+    int buffer[4];
+    const int *vp = Viewport(viewport, buffer);
+    const mat4 &inv = unprojectCache.Inverse(modelview, persp);
+    p1 = Unproject(vec3(xscreen, yscreen, .25f), inv, vp);
+    p2 = Unproject(vec3(xscreen, yscreen, .50f), inv, vp);
+        // alternatively, a second point can be determined by transforming the origin by the inverse of modelview
         // this would yield in world space the camera location, through which all view lines pass
-    p1 = vec3(static_cast<float>(a[0]), static_cast<float>(a[1]), static_cast<float>(a[2]));
-    p2 = vec3(static_cast<float>(b[0]), static_cast<float>(b[1]), static_cast<float>(b[2]));
 }
 
 // Draw Shader
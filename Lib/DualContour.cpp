@@ -0,0 +1,457 @@
+// DualContour.cpp: adaptive octree polygonization by dual contouring
+// after Ju, Losasso, Schaefer and Warren, "Dual Contouring of Hermite Data," SIGGRAPH 2002
+
+#include <math.h>
+#include <float.h>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "Polygonizer.h"
+
+namespace {
+
+using PolygonizerDetail::RES;           // # converge iterations
+using PolygonizerDetail::BIT;
+using PolygonizerDetail::LatticeKey;
+
+// corners and children are indexed (x<<2)|(y<<1)|z, as in Polygonizer
+
+// contouring tables
+
+const int edgevmap[12][2] = {
+    {0,4},{1,5},{2,6},{3,7},    // x-axis
+    {0,2},{1,3},{4,6},{5,7},    // y-axis
+    {0,1},{2,3},{4,5},{6,7}     // z-axis
+};
+const int cellProcFaceMask[12][3] = {
+    {0,4,0},{1,5,0},{2,6,0},{3,7,0},{0,2,1},{4,6,1},{1,3,1},{5,7,1},{0,1,2},{2,3,2},{4,5,2},{6,7,2}
+};
+const int cellProcEdgeMask[6][5] = {
+    {0,1,2,3,0},{4,5,6,7,0},{0,4,1,5,1},{2,6,3,7,1},{0,2,4,6,2},{1,3,5,7,2}
+};
+const int faceProcFaceMask[3][4][3] = {
+    {{4,0,0},{5,1,0},{6,2,0},{7,3,0}},
+    {{2,0,1},{6,4,1},{3,1,1},{7,5,1}},
+    {{1,0,2},{3,2,2},{5,4,2},{7,6,2}}
+};
+const int faceProcEdgeMask[3][4][6] = {
+    {{1,4,0,5,1,1},{1,6,2,7,3,1},{0,4,6,0,2,2},{0,5,7,1,3,2}},
+    {{0,2,3,0,1,0},{0,6,7,4,5,0},{1,2,0,6,4,2},{1,3,1,7,5,2}},
+    {{1,1,0,3,2,0},{1,5,4,7,6,0},{0,1,5,0,4,1},{0,3,7,2,6,1}}
+};
+const int edgeProcEdgeMask[3][2][5] = {
+    {{3,2,1,0,0},{7,6,5,4,0}},
+    {{5,1,4,0,1},{7,3,6,2,1}},
+    {{6,4,2,0,2},{7,5,3,1,2}}
+};
+const int processEdgeMask[3][4] = {{3,2,1,0},{7,5,6,4},{11,10,9,8}};
+
+// quadric error function, accumulated from edge intersections and normals
+
+struct QEF {
+    float ata[6] = {0, 0, 0, 0, 0, 0};  // upper triangle of AtA: 00, 01, 02, 11, 12, 22
+    vec3 atb;
+    float btb = 0;
+    vec3 massSum;                       // sum of intersections
+    int n = 0;
+    void Add(const vec3 &p, const vec3 &nrm) {
+        float b = dot(nrm, p);
+        ata[0] += nrm.x*nrm.x; ata[1] += nrm.x*nrm.y; ata[2] += nrm.x*nrm.z;
+        ata[3] += nrm.y*nrm.y; ata[4] += nrm.y*nrm.z; ata[5] += nrm.z*nrm.z;
+        atb += b*nrm;
+        btb += b*b;
+        massSum += p;
+        n++;
+    }
+    void Add(const QEF &q) {
+        for (int i = 0; i < 6; i++)
+            ata[i] += q.ata[i];
+        atb += q.atb;
+        btb += q.btb;
+        massSum += q.massSum;
+        n += q.n;
+    }
+    vec3 Mul(const vec3 &v) const {
+        return vec3(ata[0]*v.x+ata[1]*v.y+ata[2]*v.z,
+                    ata[1]*v.x+ata[3]*v.y+ata[4]*v.z,
+                    ata[2]*v.x+ata[4]*v.y+ata[5]*v.z);
+    }
+    float Error(const vec3 &x) const {
+        // |Ax-b|^2 = xAtAx - 2xAtb + btb
+        return dot(x, Mul(x))-2*dot(x, atb)+btb;
+    }
+    vec3 Solve(float &error) const {
+        // minimize about the mass point using a truncated pseudo-inverse of AtA
+        vec3 mass = massSum/(float) n;
+        vec3 rhs = atb-Mul(mass);
+        // Jacobi eigen-decomposition of symmetric AtA
+        float a[3][3] = {{ata[0], ata[1], ata[2]}, {ata[1], ata[3], ata[4]}, {ata[2], ata[4], ata[5]}};
+        float v[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+        for (int sweep = 0; sweep < 5; sweep++)
+            for (int p = 0; p < 2; p++)
+                for (int q = p+1; q < 3; q++) {
+                    if (fabs(a[p][q]) < 1e-12f)
+                        continue;
+                    float theta = (a[q][q]-a[p][p])/(2*a[p][q]);
+                    float t = (theta >= 0? 1.f : -1.f)/(fabs(theta)+sqrt(theta*theta+1));
+                    float c = 1/sqrt(t*t+1), s = t*c;
+                    for (int k = 0; k < 3; k++) {
+                        float akp = a[k][p], akq = a[k][q];
+                        a[k][p] = c*akp-s*akq;
+                        a[k][q] = s*akp+c*akq;
+                    }
+                    for (int k = 0; k < 3; k++) {
+                        float apk = a[p][k], aqk = a[q][k];
+                        a[p][k] = c*apk-s*aqk;
+                        a[q][k] = s*apk+c*aqk;
+                    }
+                    for (int k = 0; k < 3; k++) {
+                        float vkp = v[k][p], vkq = v[k][q];
+                        v[k][p] = c*vkp-s*vkq;
+                        v[k][q] = s*vkp+c*vkq;
+                    }
+                }
+        float maxEig = fabs(a[0][0]) > fabs(a[1][1])? fabs(a[0][0]) : fabs(a[1][1]);
+        if (fabs(a[2][2]) > maxEig) maxEig = fabs(a[2][2]);
+        vec3 x;
+        for (int e = 0; e < 3; e++) {
+            // discard small eigenvalues (flat or edge-like features)
+            if (fabs(a[e][e]) < .1f*maxEig || fabs(a[e][e]) < FLT_EPSILON)
+                continue;
+            vec3 ev(v[0][e], v[1][e], v[2][e]);
+            x += (dot(ev, rhs)/a[e][e])*ev;
+        }
+        x += mass;
+        error = Error(x);
+        return x;
+    }
+};
+
+enum NodeType {N_INTERNAL = 0, N_LEAF};
+
+struct OctNode {
+    NodeType type = N_INTERNAL;
+    int3 min;                   // LBN lattice corner, in finest cells
+    int size = 1;               // width in finest cells (power of 2)
+    int signs = 0;              // bit c set if corner c is positive
+    OctNode *children[8] = {NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL};
+    QEF qef;                    // leaf only
+    vec3 vertex;                // leaf only
+    int vid = -1;               // leaf only, set during contouring
+    ~OctNode() {
+        for (int i = 0; i < 8; i++)
+            delete children[i];
+    }
+};
+
+class Builder {
+public:
+    ImplicitProc iProc;
+    GradientProc gProc;
+    IntervalProc bound;
+    float cellSize, tolerance, lipschitz;
+    int sampleCells;
+    std::unordered_map<long long, float> corners;   // per-thread corner cache
+    Builder(ImplicitProc i, GradientProc g, float s, const AdaptiveOptions &o) :
+        iProc(i), gProc(g), bound(o.bound), cellSize(s), tolerance(o.errorTolerance), lipschitz(o.lipschitz), sampleCells(o.sampleCells) { }
+    vec3 Position(int i, int j, int k) { return vec3((float)i*cellSize, (float)j*cellSize, (float)k*cellSize); }
+    float Corner(int i, int j, int k) {
+        long long key = LatticeKey(i, j, k);
+        std::unordered_map<long long, float>::iterator it = corners.find(key);
+        if (it != corners.end())
+            return it->second;
+        float v = iProc(Position(i, j, k));
+        corners[key] = v;
+        return v;
+    }
+    vec3 Normal(const vec3 &p) {
+        vec3 n;
+        if (gProc)
+            gProc(p, n);
+        else {
+            float d = cellSize/(float)(RES*RES);
+            n = vec3(iProc(vec3(p.x+d, p.y, p.z))-iProc(vec3(p.x-d, p.y, p.z)),
+                     iProc(vec3(p.x, p.y+d, p.z))-iProc(vec3(p.x, p.y-d, p.z)),
+                     iProc(vec3(p.x, p.y, p.z+d))-iProc(vec3(p.x, p.y, p.z-d)));
+        }
+        float len = length(n);
+        return len > FLT_EPSILON? n/len : n;
+    }
+    vec3 Converge(vec3 pos, vec3 neg) {
+        vec3 p;
+        for (int i = 0; ; i++) {
+            p = .5f*(pos+neg);
+            if (i == RES)
+                return p;
+            if (iProc(p) > 0)
+                pos = p;
+            else
+                neg = p;
+        }
+    }
+    int Signs(const int3 &m, int size, float *values) {
+        int signs = 0;
+        for (int c = 0; c < 8; c++) {
+            values[c] = Corner(m.i1+size*BIT(c, 2), m.i2+size*BIT(c, 1), m.i3+size*BIT(c, 0));
+            if (values[c] > 0)
+                signs |= 1<<c;
+        }
+        return signs;
+    }
+    OctNode *MakeLeaf(const int3 &m) {
+        float values[8];
+        int signs = Signs(m, 1, values);
+        if (signs == 0 || signs == 255)
+            return NULL;
+        OctNode *n = new OctNode();
+        n->type = N_LEAF;
+        n->min = m;
+        n->signs = signs;
+        for (int e = 0; e < 12; e++) {
+            int c1 = edgevmap[e][0], c2 = edgevmap[e][1];
+            if (BIT(signs, c1) == BIT(signs, c2))
+                continue;
+            vec3 p1 = Position(m.i1+BIT(c1, 2), m.i2+BIT(c1, 1), m.i3+BIT(c1, 0));
+            vec3 p2 = Position(m.i1+BIT(c2, 2), m.i2+BIT(c2, 1), m.i3+BIT(c2, 0));
+            vec3 p = BIT(signs, c1)? Converge(p1, p2) : Converge(p2, p1);
+            n->qef.Add(p, Normal(p));
+        }
+        float error;
+        n->vertex = Clamp(n->qef.Solve(error), n);
+        return n;
+    }
+    vec3 Clamp(const vec3 &v, OctNode *n) {
+        // keep vertex within its cell, else use mass point
+        vec3 lo = Position(n->min.i1, n->min.i2, n->min.i3), hi = lo+vec3((float) n->size*cellSize);
+        for (int k = 0; k < 3; k++)
+            if (v[k] < lo[k] || v[k] > hi[k])
+                return n->qef.massSum/(float) n->qef.n;
+        return v;
+    }
+    bool Empty(const int3 &m, int size, int signs) {
+        if (signs != 0 && signs != 255)
+            return false;
+        if (lipschitz > 0) {
+            // no zero within the node if |f(center)| exceeds slope bound times half-diagonal
+            float half = .5f*(float)size*cellSize;
+            vec3 center = Position(m.i1, m.i2, m.i3)+vec3(half);
+            return fabs(iProc(center)) > lipschitz*half*1.7320508f;
+        }
+        return size <= sampleCells;
+    }
+    OctNode *Build(const int3 &m, int size) {
+        // return NULL if node contains no surface
+        if (bound) {
+            Interval range = bound(Position(m.i1, m.i2, m.i3), Position(m.i1+size, m.i2+size, m.i3+size));
+            if (range.lo > 0 || range.hi <= 0)
+                return NULL;    // no zero within node, skip without evaluating its corners
+        }
+        if (size == 1)
+            return MakeLeaf(m);
+        float values[8];
+        int signs = Signs(m, size, values);
+        if (Empty(m, size, signs))
+            return NULL;
+        OctNode *n = new OctNode();
+        n->min = m;
+        n->size = size;
+        n->signs = signs;
+        int half = size/2;
+        for (int c = 0; c < 8; c++)
+            n->children[c] = Build(int3(m.i1+half*BIT(c, 2), m.i2+half*BIT(c, 1), m.i3+half*BIT(c, 0)), half);
+        return Simplify(n);
+    }
+    OctNode *Simplify(OctNode *n) {
+        // collapse children into a single leaf if their combined QEF error is small
+        QEF qef;
+        int nChildren = 0;
+        for (int c = 0; c < 8; c++) {
+            OctNode *child = n->children[c];
+            if (!child)
+                continue;
+            if (child->type != N_LEAF)
+                return n;
+            qef.Add(child->qef);
+            nChildren++;
+        }
+        if (!nChildren) {
+            delete n;
+            return NULL;
+        }
+        float error;
+        vec3 v = qef.Solve(error);
+        vec3 lo = Position(n->min.i1, n->min.i2, n->min.i3), hi = lo+vec3((float) n->size*cellSize);
+        bool inside = v.x >= lo.x && v.y >= lo.y && v.z >= lo.z && v.x <= hi.x && v.y <= hi.y && v.z <= hi.z;
+        if (error > tolerance || !inside)
+            return n;
+        // parent corner c is child c's corner c
+        for (int c = 0; c < 8; c++) {
+            delete n->children[c];
+            n->children[c] = NULL;
+        }
+        n->type = N_LEAF;
+        n->qef = qef;
+        n->vertex = v;
+        return n;
+    }
+};
+
+class Contour {
+public:
+    Builder &builder;
+    PolyMesh &mesh;
+    Contour(Builder &b, PolyMesh &m) : builder(b), mesh(m) { }
+    int Vid(OctNode *n) {
+        if (n->vid < 0)
+            n->vid = mesh.Vertex(n->vertex, builder.Normal(n->vertex));
+        return n->vid;
+    }
+    void Cell(OctNode *n) {
+        if (!n || n->type == N_LEAF)
+            return;
+        for (int i = 0; i < 8; i++)
+            Cell(n->children[i]);
+        for (int i = 0; i < 12; i++) {
+            OctNode *f[2] = {n->children[cellProcFaceMask[i][0]], n->children[cellProcFaceMask[i][1]]};
+            Face(f, cellProcFaceMask[i][2]);
+        }
+        for (int i = 0; i < 6; i++) {
+            OctNode *e[4];
+            for (int j = 0; j < 4; j++)
+                e[j] = n->children[cellProcEdgeMask[i][j]];
+            Edge(e, cellProcEdgeMask[i][4]);
+        }
+    }
+    void Face(OctNode *n[2], int dir) {
+        if (!n[0] || !n[1])
+            return;
+        if (n[0]->type == N_LEAF && n[1]->type == N_LEAF)
+            return;
+        for (int i = 0; i < 4; i++) {
+            OctNode *f[2];
+            for (int j = 0; j < 2; j++)
+                f[j] = n[j]->type == N_LEAF? n[j] : n[j]->children[faceProcFaceMask[dir][i][j]];
+            Face(f, faceProcFaceMask[dir][i][2]);
+        }
+        const int orders[2][4] = {{0,0,1,1}, {0,1,0,1}};
+        for (int i = 0; i < 4; i++) {
+            const int *order = orders[faceProcEdgeMask[dir][i][0]];
+            OctNode *e[4];
+            for (int j = 0; j < 4; j++) {
+                OctNode *nj = n[order[j]];
+                e[j] = nj->type == N_LEAF? nj : nj->children[faceProcEdgeMask[dir][i][1+j]];
+            }
+            Edge(e, faceProcEdgeMask[dir][i][5]);
+        }
+    }
+    void Edge(OctNode *n[4], int dir) {
+        if (!n[0] || !n[1] || !n[2] || !n[3])
+            return;
+        if (n[0]->type == N_LEAF && n[1]->type == N_LEAF && n[2]->type == N_LEAF && n[3]->type == N_LEAF) {
+            ProcessEdge(n, dir);
+            return;
+        }
+        for (int i = 0; i < 2; i++) {
+            OctNode *e[4];
+            for (int j = 0; j < 4; j++)
+                e[j] = n[j]->type == N_LEAF? n[j] : n[j]->children[edgeProcEdgeMask[dir][i][j]];
+            Edge(e, edgeProcEdgeMask[dir][i][4]);
+        }
+    }
+    void ProcessEdge(OctNode *n[4], int dir) {
+        // the smallest of the four cells holds the minimal edge; quad if its sign changes
+        int minSize = 1<<30, minIndex = 0;
+        bool flip = false, change[4];
+        for (int i = 0; i < 4; i++) {
+            int edge = processEdgeMask[dir][i];
+            int s1 = BIT(n[i]->signs, edgevmap[edge][0]), s2 = BIT(n[i]->signs, edgevmap[edge][1]);
+            if (n[i]->size < minSize) {
+                minSize = n[i]->size;
+                minIndex = i;
+                flip = s1 != 0;
+            }
+            change[i] = s1 != s2;
+        }
+        if (!change[minIndex])
+            return;
+        int v[4];
+        for (int i = 0; i < 4; i++)
+            v[i] = Vid(n[i]);
+        // split along the shorter diagonal; drop triangles collapsed by shared vertices
+        int a = 0, b = 1, c = 3, d = 2;         // quad a-b-c-d
+        if (flip) { b = 2; d = 1; }
+        vec3 &pa = mesh.points[v[a]], &pb = mesh.points[v[b]], &pc = mesh.points[v[c]], &pd = mesh.points[v[d]];
+        vec3 ac = pc-pa, bd = pd-pb;
+        if (dot(ac, ac) <= dot(bd, bd)) {
+            Triangle(v[a], v[b], v[c]);
+            Triangle(v[a], v[c], v[d]);
+        }
+        else {
+            Triangle(v[a], v[b], v[d]);
+            Triangle(v[b], v[c], v[d]);
+        }
+    }
+    void Triangle(int i1, int i2, int i3) {
+        if (i1 != i2 && i2 != i3 && i3 != i1)
+            mesh.Triangle(i1, i2, i3);
+    }
+};
+
+} // end namespace
+
+void PolygonizeAdaptive(float cellSize, int bounds, ImplicitProc iProc, PolyMesh &mesh,
+                        GradientProc gProc, AdaptiveOptions options) {
+    // root is a cube of 2^depth finest cells, centered on the origin, that covers +/-bounds
+    int rootSize = 4;
+    while (rootSize < 2*bounds)
+        rootSize *= 2;
+    int half = rootSize/2, quarter = rootSize/4;
+    // build 64 subtrees concurrently, each thread with its own corner cache
+    std::vector<int3> mins;
+    for (int c = 0; c < 64; c++)
+        mins.push_back(int3(-half+quarter*((c>>4)&3), -half+quarter*((c>>2)&3), -half+quarter*(c&3)));
+    std::vector<OctNode *> subtrees(64, (OctNode *) NULL);
+    int nThreads = options.nThreads > 0? options.nThreads : (int) std::thread::hardware_concurrency();
+    if (nThreads < 1)
+        nThreads = 1;
+    std::vector<Builder> builders(nThreads, Builder(iProc, gProc, cellSize, options));
+    std::atomic<int> next(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nThreads; t++)
+        threads.push_back(std::thread([&, t]() {
+            for (int s = next++; s < 64; s = next++)
+                subtrees[s] = builders[t].Build(mins[s], quarter);
+        }));
+    for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+    // assemble top two levels, simplifying bottom-up
+    Builder &b = builders[0];
+    OctNode *root = new OctNode();
+    root->min = int3(-half, -half, -half);
+    root->size = rootSize;
+    float values[8];
+    root->signs = b.Signs(root->min, rootSize, values);
+    for (int c = 0; c < 8; c++) {
+        OctNode *n = new OctNode();
+        n->size = half;
+        n->min = int3(-half+half*BIT(c, 2), -half+half*BIT(c, 1), -half+half*BIT(c, 0));
+        n->signs = b.Signs(n->min, half, values);
+        for (int g = 0; g < 8; g++) {
+            // grandchild g of child c
+            int3 m(n->min.i1+quarter*BIT(g, 2), n->min.i2+quarter*BIT(g, 1), n->min.i3+quarter*BIT(g, 0));
+            int s = (((m.i1+half)/quarter)<<4) | (((m.i2+half)/quarter)<<2) | ((m.i3+half)/quarter);
+            n->children[g] = subtrees[s];
+        }
+        root->children[c] = b.Simplify(n);
+    }
+    root = b.Simplify(root);
+    // contour
+    Contour contour(b, mesh);
+    if (root) {
+        if (root->type == N_LEAF)
+            contour.Vid(root);
+        contour.Cell(root);
+    }
+    delete root;
+}
@@ -0,0 +1,222 @@
+// Frustum.cpp - view frustum planes, and culling of bounding spheres and boxes
+
+#include "Frustum.h"
+#include <chrono>
+#include <string.h>
+
+// Frustum
+
+void Frustum::Set(const mat4 &m) {
+    // a point is inside if its clip coordinates satisfy -w <= x, y, z <= w; with rows
+    // r0-r3 of m, -w <= x is dot(r3+r0, p) >= 0, and so on (Gribb and Hartmann)
+    for (int i = 0; i < 3; i++) {
+        planes[2*i] = m[3]+m[i];
+        planes[2*i+1] = m[3]-m[i];
+    }
+    for (int k = 0; k < 6; k++) {
+        vec4 &p = planes[k];
+        float len = length(vec3(p.x, p.y, p.z));
+        if (len > 0)
+            p /= len;
+    }
+}
+
+bool Frustum::SphereVisible(const vec3 &c, float r) const {
+    for (int k = 0; k < 6; k++)
+        if (dot(planes[k], vec4(c)) < -r)
+            return false;
+    return true;
+}
+
+bool Frustum::BoxVisible(const vec3 &min, const vec3 &max) const {
+    // test the corner farthest along each plane normal
+    for (int k = 0; k < 6; k++) {
+        const vec4 &p = planes[k];
+        vec3 corner(p.x >= 0? max.x : min.x, p.y >= 0? max.y : min.y, p.z >= 0? max.z : min.z);
+        if (dot(p, vec4(corner)) < 0)
+            return false;
+    }
+    return true;
+}
+
+// Culling
+
+// volumes are tested sixteen at a time, from the x, y, and z streams of Vec3Arrays (64-byte
+// aligned, padded to a multiple of 16, so whole groups are readable); each group gives
+// sixteen visibility bits, two groups a mask word
+
+namespace {
+
+const int GROUP = 16;
+
+struct Planes {
+    // plane coefficients, broadcast once per call
+#ifdef VECMAT_SSE
+    __m128 a[6], b[6], c[6], d[6];
+#else
+    float a[6], b[6], c[6], d[6];
+#endif
+    Planes(const Frustum &f) {
+        for (int k = 0; k < 6; k++) {
+            const vec4 &p = f.planes[k];
+#ifdef VECMAT_SSE
+            a[k] = _mm_set1_ps(p.x); b[k] = _mm_set1_ps(p.y); c[k] = _mm_set1_ps(p.z); d[k] = _mm_set1_ps(p.w);
+#else
+            a[k] = p.x; b[k] = p.y; c[k] = p.z; d[k] = p.w;
+#endif
+        }
+    }
+};
+
+uint32_t SphereBits(const Planes &p, const float *x, const float *y, const float *z, const float *r) {
+    // bit j set if sphere j of the group is inside or straddles every plane
+    uint32_t bits = 0;
+#ifdef VECMAT_SSE
+    for (int j = 0; j < GROUP; j += 4) {
+        __m128 vx = _mm_load_ps(x+j), vy = _mm_load_ps(y+j), vz = _mm_load_ps(z+j);
+        __m128 vr = _mm_loadu_ps(r+j), in = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int k = 0; k < 6; k++) {
+            __m128 e = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p.a[k], vx), _mm_mul_ps(p.b[k], vy)),
+                                  _mm_add_ps(_mm_mul_ps(p.c[k], vz), _mm_add_ps(p.d[k], vr)));
+            in = _mm_and_ps(in, _mm_cmpge_ps(e, _mm_setzero_ps()));
+        }
+        bits |= (uint32_t) _mm_movemask_ps(in) << j;
+    }
+#else
+    for (int j = 0; j < GROUP; j++) {
+        bool in = true;
+        for (int k = 0; k < 6; k++)
+            in &= p.a[k]*x[j]+p.b[k]*y[j]+(p.c[k]*z[j]+(p.d[k]+r[j])) >= 0;
+        bits |= (uint32_t) in << j;
+    }
+#endif
+    return bits;
+}
+
+uint32_t BoxBits(const Planes &p, const float *const *farX, const float *const *farY, const float *const *farZ, size_t i) {
+    // farX[k], farY[k], farZ[k] are the streams (min or max) of the corner farthest along plane k
+    uint32_t bits = 0;
+#ifdef VECMAT_SSE
+    for (int j = 0; j < GROUP; j += 4) {
+        __m128 in = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int k = 0; k < 6; k++) {
+            __m128 vx = _mm_load_ps(farX[k]+i+j), vy = _mm_load_ps(farY[k]+i+j), vz = _mm_load_ps(farZ[k]+i+j);
+            __m128 e = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p.a[k], vx), _mm_mul_ps(p.b[k], vy)),
+                                  _mm_add_ps(_mm_mul_ps(p.c[k], vz), p.d[k]));
+            in = _mm_and_ps(in, _mm_cmpge_ps(e, _mm_setzero_ps()));
+        }
+        bits |= (uint32_t) _mm_movemask_ps(in) << j;
+    }
+#else
+    for (int j = 0; j < GROUP; j++) {
+        bool in = true;
+        for (int k = 0; k < 6; k++)
+            in &= p.a[k]*farX[k][i+j]+p.b[k]*farY[k][i+j]+(p.c[k]*farZ[k][i+j]+p.d[k]) >= 0;
+        bits |= (uint32_t) in << j;
+    }
+#endif
+    return bits;
+}
+
+int CountBits(uint32_t b) {
+    b = b-((b >> 1) & 0x55555555);
+    b = (b & 0x33333333)+((b >> 2) & 0x33333333);
+    return (int) ((((b+(b >> 4)) & 0x0f0f0f0f)*0x01010101) >> 24);
+}
+
+template <class GroupBits>
+size_t Cull(size_t n, GroupBits groupBits, uint32_t *mask, std::vector<int> *visible) {
+    // fill mask and/or visible from groupBits(i), the bits for volumes i through i+GROUP-1
+    size_t nVisible = 0;
+    int *v = NULL;
+    if (visible) {
+        visible->resize(n);
+        v = visible->data();
+    }
+    for (size_t i = 0; i < n; i += 2*GROUP) {
+        uint32_t bits = groupBits(i);
+        if (i+GROUP < n)
+            bits |= groupBits(i+GROUP) << GROUP;
+        if (n-i < 2*GROUP)
+            bits &= (1u << (n-i))-1;            // clear bits for padding
+        if (mask)
+            mask[i/(2*GROUP)] = bits;
+        if (v && bits)
+            // write every index, advancing past visible ones (no branch per volume)
+            for (int j = 0; j < 2*GROUP && i+j < n; j++) {
+                v[nVisible] = (int) (i+j);
+                nVisible += (bits >> j) & 1;
+            }
+        else
+            nVisible += CountBits(bits);
+    }
+    if (visible)
+        visible->resize(nVisible);
+    return nVisible;
+}
+
+typedef std::chrono::steady_clock Clock;
+
+void Record(CullStats *stats, Clock::time_point t0, size_t spheres, size_t boxes, size_t nVisible) {
+    if (stats) {
+        stats->spheresTested += spheres;
+        stats->boxesTested += boxes;
+        stats->visible += nVisible;
+        stats->time += std::chrono::duration<double>(Clock::now()-t0).count();
+    }
+}
+
+size_t Spheres(const Frustum &f, const Vec3Array &centers, const float *radii,
+               uint32_t *mask, std::vector<int> *visible, CullStats *stats) {
+    Clock::time_point t0 = stats? Clock::now() : Clock::time_point();
+    Planes p(f);
+    size_t n = centers.Size();
+    size_t nVisible = Cull(n, [&](size_t i) {
+        const float *r = radii+i;
+        float rPad[GROUP];
+        if (n-i < GROUP) {
+            // radii are not padded
+            memset(rPad, 0, sizeof(rPad));
+            memcpy(rPad, r, (n-i)*sizeof(float));
+            r = rPad;
+        }
+        return SphereBits(p, centers.x+i, centers.y+i, centers.z+i, r);
+    }, mask, visible);
+    Record(stats, t0, n, 0, nVisible);
+    return nVisible;
+}
+
+size_t Boxes(const Frustum &f, const Vec3Array &mins, const Vec3Array &maxs,
+             uint32_t *mask, std::vector<int> *visible, CullStats *stats) {
+    Clock::time_point t0 = stats? Clock::now() : Clock::time_point();
+    Planes p(f);
+    const float *farX[6], *farY[6], *farZ[6];
+    for (int k = 0; k < 6; k++) {
+        const vec4 &q = f.planes[k];
+        farX[k] = q.x >= 0? maxs.x : mins.x;
+        farY[k] = q.y >= 0? maxs.y : mins.y;
+        farZ[k] = q.z >= 0? maxs.z : mins.z;
+    }
+    size_t n = mins.Size();
+    size_t nVisible = Cull(n, [&](size_t i) { return BoxBits(p, farX, farY, farZ, i); }, mask, visible);
+    Record(stats, t0, 0, n, nVisible);
+    return nVisible;
+}
+
+} // end namespace
+
+size_t CullSpheres(const Frustum &f, const Vec3Array &centers, const float *radii, uint32_t *mask, CullStats *stats) {
+    return Spheres(f, centers, radii, mask, NULL, stats);
+}
+
+size_t CullSpheres(const Frustum &f, const Vec3Array &centers, const float *radii, std::vector<int> &visible, CullStats *stats) {
+    return Spheres(f, centers, radii, NULL, &visible, stats);
+}
+
+size_t CullBoxes(const Frustum &f, const Vec3Array &mins, const Vec3Array &maxs, uint32_t *mask, CullStats *stats) {
+    return Boxes(f, mins, maxs, mask, NULL, stats);
+}
+
+size_t CullBoxes(const Frustum &f, const Vec3Array &mins, const Vec3Array &maxs, std::vector<int> &visible, CullStats *stats) {
+    return Boxes(f, mins, maxs, NULL, &visible, stats);
+}
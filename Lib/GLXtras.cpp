@@ -210,6 +210,27 @@ GLuint LinkProgramViaFile(const char *vertexShaderFile, const char *pixelShaderF
     return LinkProgram(vshader, fshader);
 }
 
+GLuint LinkProgramViaCode(const char **computeCode) {
+    GLuint program = 0;
+#ifdef GL_COMPUTE_SHADER
+    GLuint cshader = CompileShaderViaCode(computeCode, GL_COMPUTE_SHADER);
+    if (cshader)
+        program = glCreateProgram();
+    if (program > 0) {
+        glAttachShader(program, cshader);
+        glLinkProgram(program);
+        GLint status;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        if (status == GL_FALSE)
+            PrintProgramLog(program);
+        glDetachShader(program, cshader);
+    }
+    if (cshader)
+        glDeleteShader(cshader);
+#endif
+    return program;
+}
+
 int CurrentProgram() {
     int program = 0;
     glGetIntegerv(GL_CURRENT_PROGRAM, &program);
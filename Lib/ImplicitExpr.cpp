@@ -0,0 +1,564 @@
+// ImplicitExpr.cpp - implicit functions from formulas, compiled to register bytecode
+
+#include <ctype.h>
+#include <math.h>
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <tuple>
+#include "ImplicitExpr.h"
+#include "PolygonizerT.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define EXPR_SSE
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+enum Op {
+    INPUT, CONSTANT,                            // graph leaves (not instructions)
+    ADD, SUB, MUL, DIV, NEG, SIN, COS, ABS, SQRT, EXP, LOG, MIN, MAX, POW, SMIN, SMAX
+};
+
+const int NARGS[] = {0, 0, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 3, 3};
+
+const int MAXREGISTERS = 256, BLOCK = 64;
+
+const float PI = 3.14159265358979f;
+
+inline float Clamp01(float t) { return t < 0? 0 : t > 1? 1 : t; }
+
+inline float SMin(float a, float b, float k) {
+    // polynomial smooth minimum, equal to min(a, b) where |a-b| >= k
+    if (k <= 0) return fminf(a, b);
+    float h = Clamp01(.5f+.5f*(b-a)/k);
+    return b+h*(a-b)-k*h*(1-h);
+}
+
+inline float SMax(float a, float b, float k) { return -SMin(-a, -b, k); }
+
+float Apply(int op, float a, float b, float c) {
+    switch (op) {
+        case ADD:  return a+b;
+        case SUB:  return a-b;
+        case MUL:  return a*b;
+        case DIV:  return a/b;
+        case NEG:  return -a;
+        case SIN:  return sinf(a);
+        case COS:  return cosf(a);
+        case ABS:  return fabsf(a);
+        case SQRT: return sqrtf(a);
+        case EXP:  return expf(a);
+        case LOG:  return logf(a);
+        case MIN:  return fminf(a, b);
+        case MAX:  return fmaxf(a, b);
+        case POW:  return powf(a, b);
+        case SMIN: return SMin(a, b, c);
+        case SMAX: return SMax(a, b, c);
+    }
+    return 0;
+}
+
+// interval versions
+
+const float INF = FLT_MAX;
+
+Interval Divide(const Interval &a, const Interval &b) {
+    if (b.lo <= 0 && b.hi >= 0)
+        return Interval(-INF, INF);
+    return a*Interval(1/b.hi, 1/b.lo);
+}
+
+Interval Sin(const Interval &a) {
+    // extrema occur at pi/2+2n*pi (max) and -pi/2+2n*pi (min)
+    if (!(a.hi-a.lo < 2*PI))
+        return Interval(-1, 1);
+    float lo = fminf(sinf(a.lo), sinf(a.hi)), hi = fmaxf(sinf(a.lo), sinf(a.hi));
+    float kMax = ceilf((a.lo-PI/2)/(2*PI)), kMin = ceilf((a.lo+PI/2)/(2*PI));
+    if (PI/2+2*PI*kMax <= a.hi) hi = 1;
+    if (-PI/2+2*PI*kMin <= a.hi) lo = -1;
+    return Interval(lo, hi);
+}
+
+Interval Exp(const Interval &a) { return Interval(expf(a.lo), expf(a.hi)); }
+
+Interval Log(const Interval &a) {
+    return Interval(a.lo > 0? logf(a.lo) : -INF, a.hi > 0? logf(a.hi) : -INF);
+}
+
+Interval Pow(const Interval &a, const Interval &b) {
+    // integer exponents are expanded to products when compiled; here, assume base > 0
+    if (a.lo <= 0)
+        return Interval(-INF, INF);
+    return Exp(b*Log(a));
+}
+
+Interval SMinBound(const Interval &a, const Interval &b, const Interval &k) {
+    // min(a, b)-k/4 <= smin(a, b, k) <= min(a, b)
+    Interval m = Min(a, b);
+    return Interval(m.lo-fmaxf(k.hi, 0)/4, m.hi);
+}
+
+Interval ApplyBound(int op, const Interval &a, const Interval &b, const Interval &c) {
+    switch (op) {
+        case ADD:  return a+b;
+        case SUB:  return a-b;
+        case MUL:  return a*b;
+        case DIV:  return Divide(a, b);
+        case NEG:  return -a;
+        case SIN:  return Sin(a);
+        case COS:  return Sin(a+Interval(PI/2));
+        case ABS:  return Abs(a);
+        case SQRT: return Sqrt(a);
+        case EXP:  return Exp(a);
+        case LOG:  return Log(a);
+        case MIN:  return Min(a, b);
+        case MAX:  return Max(a, b);
+        case POW:  return Pow(a, b);
+        case SMIN: return SMinBound(a, b, c);
+        case SMAX: return -SMinBound(-a, -b, c);
+    }
+    return Interval(0);
+}
+
+// expression graph: children precede parents, identical nodes are shared
+
+struct Node {
+    int op, a, b, c;
+    float value;
+};
+
+class Graph {
+public:
+    std::vector<Node> nodes;
+    std::map<std::tuple<int, int, int, int, float>, int> ids;
+    Graph() {
+        for (int i = 0; i < 3; i++)
+            Add(INPUT, i, -1, -1, 0);
+    }
+    int Add(int op, int a, int b, int c, float value) {
+        std::tuple<int, int, int, int, float> key(op, a, b, c, value);
+        std::map<std::tuple<int, int, int, int, float>, int>::iterator it = ids.find(key);
+        if (it != ids.end())
+            return it->second;          // common subexpression
+        Node n = {op, a, b, c, value};
+        nodes.push_back(n);
+        return ids[key] = (int) nodes.size()-1;
+    }
+    int Constant(float v) { return Add(CONSTANT, -1, -1, -1, v); }
+    bool IsConstant(int n, float v) { return nodes[n].op == CONSTANT && nodes[n].value == v; }
+    int Make(int op, int a, int b = -1, int c = -1) {
+        int nArgs = NARGS[op];
+        // fold constants
+        bool constant = nodes[a].op == CONSTANT && (nArgs < 2 || nodes[b].op == CONSTANT) && (nArgs < 3 || nodes[c].op == CONSTANT);
+        if (constant)
+            return Constant(Apply(op, nodes[a].value, nArgs > 1? nodes[b].value : 0, nArgs > 2? nodes[c].value : 0));
+        // simplify
+        if (op == ADD && IsConstant(a, 0)) return b;
+        if ((op == ADD || op == SUB) && IsConstant(b, 0)) return a;
+        if (op == SUB && IsConstant(a, 0)) return Make(NEG, b);
+        if (op == SUB && a == b) return Constant(0);
+        if (op == MUL && IsConstant(a, 1)) return b;
+        if ((op == MUL || op == DIV) && IsConstant(b, 1)) return a;
+        if (op == MUL && (IsConstant(a, 0) || IsConstant(b, 0))) return Constant(0);
+        if (op == DIV && nodes[b].op == CONSTANT) return Make(MUL, a, Constant(1/nodes[b].value));
+        if (op == NEG && nodes[a].op == NEG) return nodes[a].a;
+        if ((op == MIN || op == MAX) && a == b) return a;
+        if (op == POW && nodes[b].op == CONSTANT) return Power(a, nodes[b].value);
+        // order arguments of commutative operations, so a+b and b+a are shared
+        if ((op == ADD || op == MUL || op == MIN || op == MAX) && a > b) {
+            int t = a; a = b; b = t;
+        }
+        return Add(op, a, b, c, 0);
+    }
+    int Power(int a, float e) {
+        // expand small integer and half-integer exponents
+        if (e == .5f)
+            return Make(SQRT, a);
+        if (e == floorf(e) && fabsf(e) <= 16) {
+            int n = (int) fabsf(e), result = Constant(1), square = a;
+            for (; n; n >>= 1) {
+                if (n&1)
+                    result = Make(MUL, result, square);
+                if (n > 1)
+                    square = Make(MUL, square, square);
+            }
+            return e < 0? Make(DIV, Constant(1), result) : result;
+        }
+        return Add(POW, a, Constant(e), -1, 0);
+    }
+};
+
+// recursive-descent parser
+
+class Parser {
+public:
+    Graph &g;
+    const char *s;
+    std::string error;
+    Parser(Graph &g, const char *s) : g(g), s(s) { }
+    void Skip() { while (isspace(*s)) s++; }
+    bool Accept(char c) {
+        Skip();
+        if (*s != c)
+            return false;
+        s++;
+        return true;
+    }
+    int Fail(const char *message) {
+        if (error.empty())
+            error = std::string(message)+(*s? " at \""+std::string(s, strnlen(s, 20))+"\"" : " at end");
+        return -1;
+    }
+    int Expression() {
+        // expression: term (('+' | '-') term)*
+        int n = Term();
+        while (n >= 0) {
+            if (Accept('+')) {
+                int t = Term();
+                n = t < 0? t : g.Make(ADD, n, t);
+            }
+            else if (Accept('-')) {
+                int t = Term();
+                n = t < 0? t : g.Make(SUB, n, t);
+            }
+            else
+                break;
+        }
+        return n;
+    }
+    int Term() {
+        // term: unary (('*' | '/') unary)*
+        int n = Unary();
+        while (n >= 0) {
+            if (Accept('*')) {
+                int u = Unary();
+                n = u < 0? u : g.Make(MUL, n, u);
+            }
+            else if (Accept('/')) {
+                int u = Unary();
+                n = u < 0? u : g.Make(DIV, n, u);
+            }
+            else
+                break;
+        }
+        return n;
+    }
+    int Unary() {
+        // unary: '-' unary | '+' unary | power
+        if (Accept('-')) {
+            int n = Unary();
+            return n < 0? n : g.Make(NEG, n);
+        }
+        if (Accept('+'))
+            return Unary();
+        return Power();
+    }
+    int Power() {
+        // power: primary ('^' unary)?
+        int n = Primary();
+        if (n >= 0 && Accept('^')) {
+            int e = Unary();
+            n = e < 0? e : g.Make(POW, n, e);
+        }
+        return n;
+    }
+    int Primary() {
+        Skip();
+        if (Accept('(')) {
+            int n = Expression();
+            return n < 0? n : Accept(')')? n : Fail("expected )");
+        }
+        if (isdigit(*s) || *s == '.') {
+            char *end;
+            float v = strtof(s, &end);
+            if (end == s)
+                return Fail("bad number");
+            s = end;
+            return g.Constant(v);
+        }
+        if (!isalpha(*s))
+            return Fail(*s? "unexpected character" : "expected operand");
+        const char *start = s;
+        while (isalnum(*s) || *s == '_')
+            s++;
+        std::string name(start, s-start);
+        if (name == "x") return 0;
+        if (name == "y") return 1;
+        if (name == "z") return 2;
+        if (name == "pi") return g.Constant(PI);
+        // function call
+        std::vector<int> args;
+        if (!Accept('(')) {
+            s = start;
+            return Fail("unknown variable");
+        }
+        do {
+            int a = Expression();
+            if (a < 0)
+                return a;
+            args.push_back(a);
+        } while (Accept(','));
+        if (!Accept(')'))
+            return Fail("expected )");
+        const char *end = s;
+        s = start;              // report errors at function name
+        int n = Call(name, args);
+        s = end;
+        return n;
+    }
+    int Call(std::string &name, std::vector<int> &args) {
+        static const struct {const char *name; int op;} unary[] = {
+            {"sin", SIN}, {"cos", COS}, {"abs", ABS}, {"sqrt", SQRT}, {"exp", EXP}, {"log", LOG}};
+        int nArgs = (int) args.size();
+        for (int i = 0; i < 6; i++)
+            if (name == unary[i].name)
+                return nArgs == 1? g.Make(unary[i].op, args[0]) : Fail("expected one argument");
+        if (name == "min" || name == "max") {
+            if (nArgs < 2)
+                return Fail("expected two or more arguments");
+            int n = args[0];
+            for (int i = 1; i < nArgs; i++)
+                n = g.Make(name == "min"? MIN : MAX, n, args[i]);
+            return n;
+        }
+        if (name == "pow")
+            return nArgs == 2? g.Make(POW, args[0], args[1]) : Fail("expected two arguments");
+        if (name == "smin" || name == "smax")
+            return nArgs == 3? g.Make(name == "smin"? SMIN : SMAX, args[0], args[1], args[2]) : Fail("expected three arguments");
+        if (name == "clamp")
+            return nArgs == 3? g.Make(MIN, g.Make(MAX, args[0], args[1]), args[2]) : Fail("expected three arguments");
+        if (name == "length") {
+            if (nArgs < 2 || nArgs > 3)
+                return Fail("expected two or three arguments");
+            int sum = g.Make(MUL, args[0], args[0]);
+            for (int i = 1; i < nArgs; i++)
+                sum = g.Make(ADD, sum, g.Make(MUL, args[i], args[i]));
+            return g.Make(SQRT, sum);
+        }
+        return Fail("unknown function");
+    }
+};
+
+} // end namespace
+
+// the interval pruning and batched evaluation of Polygonize apply to the recommended std::cref
+static_assert(PolygonizerDetail::HasBound<PolygonizerDetail::Unwrapped<std::reference_wrapper<const ImplicitExpr> >::type>::value &&
+              PolygonizerDetail::HasEvaluateBatch<std::reference_wrapper<const ImplicitExpr> >::value, "ImplicitExpr traits");
+
+// Compilation
+
+bool ImplicitExpr::Compile(const char *formula) {
+    code.resize(0);
+    constants.resize(0);
+    nRegisters = result = 0;
+    error.clear();
+    Graph g;
+    Parser parser(g, formula);
+    int root = parser.Expression();
+    parser.Skip();
+    if (root >= 0 && *parser.s)
+        root = parser.Fail("unexpected character");
+    if (root < 0) {
+        error = parser.error;
+        return false;
+    }
+    // mark nodes used by root (children precede parents, so visit in reverse)
+    int nNodes = (int) g.nodes.size();
+    std::vector<bool> used(nNodes, false);
+    std::vector<int> lastUse(nNodes, -1), reg(nNodes, -1);
+    used[root] = true;
+    for (int n = root; n >= 0; n--)
+        if (used[n]) {
+            Node &node = g.nodes[n];
+            int nArgs = node.op > CONSTANT? NARGS[node.op] : 0;
+            int args[] = {node.a, node.b, node.c};
+            for (int i = 0; i < nArgs; i++)
+                used[args[i]] = true;
+        }
+    // registers: x, y, z, then constants, then temporaries
+    for (int i = 0; i < 3; i++)
+        reg[i] = i;
+    for (int n = 0; n < nNodes; n++)
+        if (used[n] && g.nodes[n].op == CONSTANT) {
+            reg[n] = 3+(int) constants.size();
+            constants.push_back(g.nodes[n].value);
+        }
+    // last use of each node, by instruction node
+    for (int n = 0; n < nNodes; n++)
+        if (used[n] && g.nodes[n].op > CONSTANT) {
+            Node &node = g.nodes[n];
+            int args[] = {node.a, node.b, node.c};
+            for (int i = 0; i < NARGS[node.op]; i++)
+                lastUse[args[i]] = n;
+        }
+    // emit instructions, reusing temporaries after their last use
+    int nFixed = 3+(int) constants.size();
+    std::vector<int> freeRegs;
+    nRegisters = nFixed;
+    for (int n = 0; n < nNodes; n++) {
+        Node &node = g.nodes[n];
+        if (!used[n] || node.op <= CONSTANT)
+            continue;
+        int dst;
+        if (freeRegs.size()) {
+            dst = freeRegs.back();
+            freeRegs.pop_back();
+        }
+        else
+            dst = nRegisters++;
+        reg[n] = dst;
+        int args[] = {node.a, node.b, node.c}, nArgs = NARGS[node.op];
+        Instruction i = {(unsigned char) node.op, (unsigned short) dst,
+                         (unsigned short) reg[args[0]],
+                         (unsigned short) (nArgs > 1? reg[args[1]] : 0),
+                         (unsigned short) (nArgs > 2? reg[args[2]] : 0)};
+        code.push_back(i);
+        // release argument temporaries (after dst is chosen, so dst never aliases an argument)
+        for (int k = 0; k < nArgs; k++) {
+            bool repeat = false;        // an argument may appear more than once, free it once
+            for (int j = 0; j < k; j++)
+                repeat |= args[j] == args[k];
+            if (reg[args[k]] >= nFixed && lastUse[args[k]] == n && !repeat)
+                freeRegs.push_back(reg[args[k]]);
+        }
+    }
+    result = reg[root];
+    if (nRegisters > MAXREGISTERS) {
+        code.resize(0);
+        constants.resize(0);
+        nRegisters = result = 0;
+        error = "formula too large";
+        return false;
+    }
+    return true;
+}
+
+// Evaluation
+
+#ifdef EXPR_SSE
+
+namespace {
+
+inline __m128 SMin4(__m128 a, __m128 b, __m128 k) {
+    // as SMin, four at a time
+    __m128 zero = _mm_setzero_ps(), half = _mm_set1_ps(.5f), one = _mm_set1_ps(1);
+    __m128 h = _mm_add_ps(half, _mm_div_ps(_mm_mul_ps(half, _mm_sub_ps(b, a)), k));
+    h = _mm_min_ps(_mm_max_ps(h, zero), one);
+    __m128 blend = _mm_sub_ps(_mm_add_ps(b, _mm_mul_ps(h, _mm_sub_ps(a, b))), _mm_mul_ps(k, _mm_mul_ps(h, _mm_sub_ps(one, h))));
+    __m128 positive = _mm_cmpgt_ps(k, zero);
+    return _mm_or_ps(_mm_and_ps(positive, blend), _mm_andnot_ps(positive, _mm_min_ps(a, b)));
+}
+
+} // end namespace
+
+#endif
+
+template <int LANES>
+void ImplicitExpr::Run(float *regs) const {
+    // register r, lane i is regs[r*LANES+i]; each instruction is applied to all lanes
+    for (size_t n = 0; n < code.size(); n++) {
+        const Instruction &i = code[n];
+        float *d = regs+i.dst*LANES;
+        const float *a = regs+i.a*LANES, *b = regs+i.b*LANES, *c = regs+i.c*LANES;
+#ifdef EXPR_SSE
+        if (LANES%4 == 0) {
+            // arithmetic four lanes at a time; transcendentals fall through to libm
+            __m128 sign = _mm_set1_ps(-0.f);
+            bool done = true;
+            for (int k = 0; k < LANES && done; k += 4) {
+                __m128 va = _mm_loadu_ps(a+k), vb = _mm_loadu_ps(b+k), r;
+                switch (i.op) {
+                    case ADD:  r = _mm_add_ps(va, vb); break;
+                    case SUB:  r = _mm_sub_ps(va, vb); break;
+                    case MUL:  r = _mm_mul_ps(va, vb); break;
+                    case DIV:  r = _mm_div_ps(va, vb); break;
+                    case NEG:  r = _mm_xor_ps(va, sign); break;
+                    case ABS:  r = _mm_andnot_ps(sign, va); break;
+                    case SQRT: r = _mm_sqrt_ps(va); break;
+                    case MIN:  r = _mm_min_ps(va, vb); break;
+                    case MAX:  r = _mm_max_ps(va, vb); break;
+                    case SMIN: r = SMin4(va, vb, _mm_loadu_ps(c+k)); break;
+                    case SMAX: r = _mm_xor_ps(SMin4(_mm_xor_ps(va, sign), _mm_xor_ps(vb, sign), _mm_loadu_ps(c+k)), sign); break;
+                    default:   done = false; continue;
+                }
+                _mm_storeu_ps(d+k, r);
+            }
+            if (done)
+                continue;
+        }
+#endif
+        switch (i.op) {
+            case ADD:  for (int k = 0; k < LANES; k++) d[k] = a[k]+b[k]; break;
+            case SUB:  for (int k = 0; k < LANES; k++) d[k] = a[k]-b[k]; break;
+            case MUL:  for (int k = 0; k < LANES; k++) d[k] = a[k]*b[k]; break;
+            case DIV:  for (int k = 0; k < LANES; k++) d[k] = a[k]/b[k]; break;
+            case NEG:  for (int k = 0; k < LANES; k++) d[k] = -a[k]; break;
+            case SIN:  for (int k = 0; k < LANES; k++) d[k] = sinf(a[k]); break;
+            case COS:  for (int k = 0; k < LANES; k++) d[k] = cosf(a[k]); break;
+            case ABS:  for (int k = 0; k < LANES; k++) d[k] = fabsf(a[k]); break;
+            case SQRT: for (int k = 0; k < LANES; k++) d[k] = sqrtf(a[k]); break;
+            case EXP:  for (int k = 0; k < LANES; k++) d[k] = expf(a[k]); break;
+            case LOG:  for (int k = 0; k < LANES; k++) d[k] = logf(a[k]); break;
+            case MIN:  for (int k = 0; k < LANES; k++) d[k] = a[k] < b[k]? a[k] : b[k]; break;
+            case MAX:  for (int k = 0; k < LANES; k++) d[k] = a[k] > b[k]? a[k] : b[k]; break;
+            case POW:  for (int k = 0; k < LANES; k++) d[k] = powf(a[k], b[k]); break;
+            case SMIN: for (int k = 0; k < LANES; k++) d[k] = SMin(a[k], b[k], c[k]); break;
+            case SMAX: for (int k = 0; k < LANES; k++) d[k] = SMax(a[k], b[k], c[k]); break;
+        }
+    }
+}
+
+float ImplicitExpr::Evaluate(const vec3 &p) const {
+    // an object not compiled (or whose compile failed) has no registers, and evaluates to 0
+    if (!nRegisters)
+        return 0;
+    float regs[MAXREGISTERS];
+    regs[0] = p.x;
+    regs[1] = p.y;
+    regs[2] = p.z;
+    for (size_t i = 0; i < constants.size(); i++)
+        regs[3+i] = constants[i];
+    Run<1>(regs);
+    return regs[result];
+}
+
+void ImplicitExpr::Evaluate(const vec3 *points, float *values, int n) const {
+    if (!nRegisters) {
+        memset(values, 0, n*sizeof(float));
+        return;
+    }
+    std::vector<float> regs(nRegisters*BLOCK, 0);
+    for (size_t i = 0; i < constants.size(); i++)
+        for (int k = 0; k < BLOCK; k++)
+            regs[(3+i)*BLOCK+k] = constants[i];
+    for (int start = 0; start < n; start += BLOCK) {
+        int count = n-start < BLOCK? n-start : BLOCK;
+        float *x = &regs[0], *y = x+BLOCK, *z = y+BLOCK;
+        for (int k = 0; k < count; k++) {
+            x[k] = points[start+k].x;
+            y[k] = points[start+k].y;
+            z[k] = points[start+k].z;
+        }
+        Run<BLOCK>(&regs[0]);
+        memcpy(values+start, &regs[result*BLOCK], count*sizeof(float));
+    }
+}
+
+Interval ImplicitExpr::Bound(const vec3 &min, const vec3 &max) const {
+    if (!nRegisters)
+        return Interval(0);
+    std::vector<Interval> regs(nRegisters > 3? nRegisters : 3);
+    regs[0] = Interval(min.x, max.x);
+    regs[1] = Interval(min.y, max.y);
+    regs[2] = Interval(min.z, max.z);
+    for (size_t i = 0; i < constants.size(); i++)
+        regs[3+i] = Interval(constants[i]);
+    for (size_t n = 0; n < code.size(); n++) {
+        const Instruction &i = code[n];
+        regs[i.dst] = ApplyBound(i.op, regs[i.a], regs[i.b], regs[i.c]);
+    }
+    return regs[result];
+}
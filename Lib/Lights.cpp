@@ -1,7 +1,9 @@
 // Lights.cpp - representation/operations on lights
 
+#include <glad.h>
 #include "Draw.h"
 #include "Lights.h"
+#include "Transform.h"
 #include <stdio.h>
 
 vec3 palette[] = {vec3(1,0,0), vec3(0,1,0), vec3(0,0,1), vec3(1,1,0), vec3(1,0.6f,0), vec3(1,0,1), vec3(0,1,1), vec3(1,1,1)};
@@ -11,11 +13,9 @@ static int xCursorOffset = -7, yCursorOffset = -3; // for GLFW
 void Lights::Transform(mat4 view, vector<vec3> &xLights) {
     int nlights = lights.size();
     xLights.resize(nlights);
-    for (int i = 0; i < nlights; i++) {
-        Light l = lights[i];
-        vec4 h = view*vec4(l.p, 1);
-        xLights[i] = vec3(h.x, h.y, h.z);
-    }
+    for (int i = 0; i < nlights; i++)
+        xLights[i] = lights[i].p;
+    TransformPoints(view, xLights.data(), xLights.data(), nlights);
 }
 
 void Lights::TransformSetColors(mat4 view, vector<vec3> &xLights, vector<vec3> &colors) {
@@ -37,8 +37,17 @@ void Lights::Display(void *hover) {
 }
 
 Light *Lights::MouseOver(int x, int y, mat4 fullview) {
-    for (size_t i = 0; i < lights.size(); i++)
-        if (::MouseOver(x, y, lights[i].p, fullview, xCursorOffset, yCursorOffset))
+    // project all lights at once, rather than one ScreenPoint (and viewport query) each
+    int nlights = lights.size(), vp[4];
+    glGetIntegerv(GL_VIEWPORT, vp);
+    vector<vec3> points(nlights);
+    vector<vec2> screen(nlights);
+    for (int i = 0; i < nlights; i++)
+        points[i] = lights[i].p;
+    ProjectToScreen(fullview, vp, points.data(), screen.data(), nlights);
+    for (int i = 0; i < nlights; i++)
+        if (::MouseOver(x, y, screen[i], -xCursorOffset, yCursorOffset))
+            // as the previous per-light call, which passed the offsets as proximity and x offset
             return &lights[i];
     return NULL;
 }
@@ -1,6 +1,7 @@
 // Mesh.cpp - mesh IO and operations
 
 #include "Mesh.h"
+#include "Transform.h"
 #include <assert.h>
 #include <iostream>
 #include <fstream>
@@ -158,17 +159,13 @@ void Normalize(vector<vec3> &points, float scale) {
         if ((max[k]-min[k]) > maxrange)
             maxrange = max[k]-min[k];
     float s = scale*2.f/maxrange;
-    for (int i = 0; i < (int) points.size(); i++) {
-        vec3 &v = points[i];
-        for (int k = 0; k < 3; k++)
-            v[k] = s*(v[k]-center[k]);
-    }
+    TransformPoints(Scale(s, s, s)*Translate(-center), points.data(), points.data(), points.size());
 }
 
 void SetVertexNormals(vector<vec3> &points, vector<int3> &triangles, vector<vec3> &normals) {
     // size normals array and initialize to zero
     int nverts = (int) points.size();
-    normals.resize(nverts, vec3(0,0,0));
+    normals.resize(nverts);
     // accumulate each triangle normal into its three vertex normals
     for (int i = 0; i < (int) triangles.size(); i++) {
         int3 &t = triangles[i];
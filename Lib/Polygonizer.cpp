@@ -1,469 +1,444 @@
 // Polygonizer.cpp (c) Jules Bloomenthal, 2014-18
+// C-style interface: a thin wrapper around the template in PolygonizerT.h
 
 #include <math.h>
-#include <stdlib.h>
-#include <iostream>
-#include <sys/types.h>
-#include <stdio.h>
+#include <string.h>
+#include <unordered_map>
 #include <vector>
 #include "Polygonizer.h"
-#include "VecMat.h"
 
 namespace {
 
-const int RES = 9;              // # converge iterations
-enum {L=0, R, B, T, N, F};      // left, right, bottom, top, near, far
-enum {LBN=0, LBF, LTN, LTF, RBN, RBF, RTN, RTF};
+// wrappers for the C-style callbacks
 
-// the LBN corner of cube (i, j, k), corresponds with location (i*size, j*size, k*size)
-// *** no longer: (start.x+(i-.5)*size, start.y+(j-.5)*size, start.z+(k-.5)*size)
-
-const int HASHBIT = 5;
-const int HASHSIZE = ((size_t)(1<<(3*HASHBIT)));
-const int MASK = ((1<<HASHBIT)-1);
-
-inline int HASH( int i, int j,int k) {
-    return (((( (i&MASK) << HASHBIT) | (j&MASK)) << HASHBIT) | (k&MASK));
-}
-
-inline int BIT(int i, int bit) {
-    return (i>>bit)&1;
-}
-
-inline float RAND() {
-    return (rand()&32767)/32767.0f;
-}
-
-inline int FLIP(int i, int bit) {
-    return i^1<<bit;
-}
-
-struct TEST {                   // test the function for a signed value
-    vec3 p;                     // location of test
-    float value;                // function value at p
-    int ok;                     // if value is of correct sign
+struct ProcField {
+    ImplicitProc proc;
+    float operator() (const vec3 &p) const { return proc(p); }
 };
 
-struct CORNER {                 // corner of a cube
-    int i, j, k;                // (i, j, k) is index within lattice
-    float x, y, z, value;       // location and function value
+struct ProcSink {
+    VertexProc vProc;
+    TriangleProc tProc;
+    int Vertex(const vec3 &p, const vec3 &n) { return vProc(p, n); }
+    bool Triangle(int i1, int i2, int i3) { return tProc(i1, i2, i3); }
 };
 
-struct CUBE {                   // partitioning cell (cube)
-    int i, j, k;                // lattice location of cube
-    float values[8];
-    bool transects;
+struct ProcGradient {
+    GradientProc proc;
+    float operator() (const vec3 &p, vec3 &g) const { return proc(p, g); }
 };
 
-typedef struct cubes {
-    // linked list of cubes acting as stack
-    CUBE cube;                  // a single cube
-    struct cubes *next;         // remaining elements
-} CUBES;
+inline bool Enabled(const ProcGradient &g) { return g.proc != NULL; }
 
-typedef struct centerlist {
-    // list of cube locations
-    int i, j, k;                // cube location
-    struct centerlist *next;    // remaining elements
-} CENTERLIST;
-
-typedef struct cornerlist {
-    // list of corners
-    int i, j, k;                // corner id
-    float value;                // corner value
-    struct cornerlist *next;    // remaining elements
-} CORNERLIST;
+} // end namespace
 
-typedef struct edgelist {
-    // list of edges
-    unsigned int i1, j1, k1, i2, j2, k2; // edge corner ids
-    int vid;                    // vertex id
-    struct edgelist *next;      // remaining elements
-} EDGELIST;
+bool Polygonize(std::vector<vec3> &starts, float cellSize, int bounds,
+                ImplicitProc iProc,
+                VertexProc vProc,
+                TriangleProc tProc,
+                GradientProc gProc,
+                PolygonizeStats *stats) {
+    ProcField field = {iProc};
+    ProcSink sink = {vProc, tProc};
+    ProcGradient gradient = {gProc};
+    return Polygonize(starts, cellSize, bounds, field, sink, gradient, stats);
+}
 
-// mycalloc used for CUBES *cubes, CENTERLIST **centers, CORNERLIST **corners, EDGELIST **edges
-// FreeAll frees edges, corners, centers (cubes deallocated during March()
+bool Polygonize(vec3 &start, float cellSize, int bounds,
+                ImplicitProc iProc,
+                VertexProc vProc,
+                TriangleProc tProc,
+                GradientProc gProc,
+                PolygonizeStats *stats) {
+    std::vector<vec3> starts(1, start);
+    return Polygonize(starts, cellSize, bounds,
+        iProc,
+        vProc,
+        tProc,
+        gProc,
+        stats);
+}
 
-char *mycalloc (int nitems, int nbytes) {
-    char *ptr = (char *) calloc(nitems, nbytes);
-    if (ptr == NULL)
-        throw("can't allocate memory");
-    return ptr;
+bool Polygonize(std::vector<vec3> &starts, float cellSize, int bounds,
+                ImplicitProc iProc,
+                PolyMesh &mesh,
+                GradientProc gProc,
+                int nTrianglesHint,
+                PolygonizeStats *stats) {
+    ProcField field = {iProc};
+    ProcGradient gradient = {gProc};
+    if (nTrianglesHint > 0)
+        mesh.Reserve(mesh.triangles.size()+nTrianglesHint);
+    return Polygonize(starts, cellSize, bounds, field, mesh, gradient, stats);
 }
 
-class Process {
-public:
-    // parameters, function, storage
-    ImplicitProc  iProc;
-    VertexProc    vProc;
-    TriangleProc  tProc;
-    float         size;         // cube size
-    float         delta;        // normal delta
-    int           bounds;       // cube range within lattice
-    CUBES        *cubes;        // active cubes
-    CENTERLIST  **centers;      // cube center hash table (prevent cycling)
-    CORNERLIST  **corners;      // corner value hash table
-    EDGELIST    **edges;        // edge and vertex id hash table
+bool Polygonize(float cellSize, int bounds,
+                ImplicitProc iProc,
+                VertexProc vProc,
+                TriangleProc tProc,
+                GradientProc gProc,
+                int coarse,
+                PolygonizeStats *stats) {
+    ProcField field = {iProc};
+    ProcSink sink = {vProc, tProc};
+    ProcGradient gradient = {gProc};
+    return Polygonize(cellSize, bounds, field, sink, gradient, coarse, stats);
+}
 
-    void FreeAll () {
-        int index;
-        CORNERLIST *l, *lnext;
-        CENTERLIST *cl, *clnext;
-        EDGELIST *edge, *edgenext;
-        if (corners)
-            for (index = 0; index < HASHSIZE; index++)
-                for (l = corners[index]; l; l = lnext) {
-                    lnext = l->next;
-                    free(l);    // free CORNERLIST
-                }
-        if (centers)
-            for (index = 0; index < HASHSIZE; index++)
-                for (cl = centers[index]; cl; cl = clnext) {
-                    clnext = cl->next;
-                    free(cl);   // free CENTERLIST
-                }
-        if (edges)
-            for (index = 0; index < 2*HASHSIZE; index++)
-                for (edge = edges[index]; edge; edge = edgenext) {
-                    edgenext = edge->next;
-                    free(edge); // free EDGELIST
-                }
-        free(edges);            // free array of EDGELIST pointers
-        free(corners);          // free array of CORNERLIST pointers
-        free(centers);          // free array of CENTERLIST pointers
-        edges = NULL;
-        corners = NULL;
-        centers = NULL;
-    }
+bool Polygonize(float cellSize, int bounds,
+                ImplicitProc iProc,
+                PolyMesh &mesh,
+                GradientProc gProc,
+                int coarse,
+                PolygonizeStats *stats) {
+    ProcField field = {iProc};
+    ProcGradient gradient = {gProc};
+    return Polygonize(cellSize, bounds, field, mesh, gradient, coarse, stats);
+}
 
-    TEST Find(int sign, vec3 &p) {
-        // search for point with value of given sign (0: neg, 1: pos)
-        int i;
-        TEST test;
-        float range = size;
-        test.ok = 1;
-        for (i = 0; i < 10000; i++) {
-            test.p.x = p.x+range*(RAND()-0.5f);
-            test.p.y = p.y+range*(RAND()-0.5f);
-            test.p.z = p.z+range*(RAND()-0.5f);
-            test.value = iProc(test.p);
-            if (sign == (test.value > 0.0))
-                return test;
-            range = range*1.0005f; // slowly expand search outwards
-        }
-        test.ok = 0;
-        return test;
+void Merge(std::vector<PolyMesh> &parts, PolyMesh &result) {
+    size_t nPoints = result.points.size(), nTriangles = result.triangles.size();
+    for (size_t i = 0; i < parts.size(); i++) {
+        nPoints += parts[i].points.size();
+        nTriangles += parts[i].triangles.size();
     }
-
-    CUBE MakeCube(int3 ijk) {
-        int npos = 0, nneg = 0;
-        CUBE c;
-        c.i = ijk.i1;
-        c.j = ijk.i2;
-        c.k = ijk.i3;
-        for (int n = 0; n < 8; n++) {
-            c.values[n] = SetCorner(c.i+BIT(n,2), c.j+BIT(n,1), c.k+BIT(n,0));
-            float val = c.values[n];
-            val < 0? nneg++ : val > 0? npos++ : 0;
+    result.points.reserve(nPoints);
+    result.normals.reserve(nPoints);
+    result.triangles.reserve(nTriangles);
+    for (size_t i = 0; i < parts.size(); i++) {
+        PolyMesh &m = parts[i];
+        int offset = (int) result.points.size();
+        result.points.insert(result.points.end(), m.points.begin(), m.points.end());
+        result.normals.insert(result.normals.end(), m.normals.begin(), m.normals.end());
+        for (size_t t = 0; t < m.triangles.size(); t++) {
+            int3 &tri = m.triangles[t];
+            result.triangles.push_back(int3(tri.i1+offset, tri.i2+offset, tri.i3+offset));
         }
-        c.transects = nneg > 0 && npos > 0;
-        return c;
     }
+}
 
-    void AddToStack(CUBE &c) {
-        if (!SetCenter(centers, c.i, c.j, c.k)) {         // not previously set
-            // add new cube to top of stack
-            CUBES *oldcubes = cubes;
-            cubes = (CUBES *) mycalloc(1, sizeof(CUBES)); // freed in March
-            cubes->cube = c;
-            cubes->next = oldcubes;
-        }
-    }
+// Mesh Cleanup
 
-    bool AddToStack(vec3 &q) {
-        TEST in, out;
-        in = Find(1, q);
-        out = Find(0, q);
-        if (!in.ok || !out.ok) {
-            // throw("can't find starting point");
-            return false;
-        }
-        vec3 p;
-        Converge(in.p, out.p, in.value, p);
-        int3 ijk = LatticeIJK(p);
-        CUBE c = MakeCube(ijk);
-        if (c.transects)
-            AddToStack(c);
-        else {
-            // no transection (q must graze cube face, edge, or vertex), add face neighbors
-            int3 ids[] = {int3(c.i-1, c.j, c.k), int3(c.i+1, c.j, c.k),
-                          int3(c.i, c.j-1, c.k), int3(c.i, c.j+1, c.k),
-                          int3(c.i, c.j, c.k-1), int3(c.i, c.j, c.k+1)};
-            for (int i = 0; i < 6; i++) {
-                CUBE c = MakeCube(ids[i]);
-                AddToStack(c);
-              }
-        }
-        return true;
-    }
+namespace {
 
-    int3 LatticeIJK(vec3 &p) {
-        return int3((int) floor(p.x/size), (int) floor(p.y/size), (int) floor(p.z/size));
+struct Collapser {
+    // edge collapse preserving manifold topology; a vertex's triangles are the adjacency
+    // lists of the vertices merged into it, chained through member, less dead triangles
+    PolyMesh &mesh;
+    std::vector<char> &snapped;             // vertex at a lattice corner
+    std::vector<char> alive;                // per triangle
+    std::vector<int> first, fan;            // per vertex, its triangles are fan[first[v]]-fan[first[v+1]-1]
+    std::vector<int> member;                // next vertex merged into the same vertex, or -1
+    std::vector<int> mark, count;           // neighbor tests
+    int stamp = 0;
+    Collapser(PolyMesh &m, std::vector<char> &s) : mesh(m), snapped(s), alive(m.triangles.size(), 1),
+            member(m.points.size(), -1), mark(m.points.size(), 0), count(m.points.size(), 0) {
+        int nVertices = (int) mesh.points.size();
+        first.assign(nVertices+1, 0);
+        for (size_t t = 0; t < mesh.triangles.size(); t++)
+            for (int k = 0; k < 3; k++)
+                first[mesh.triangles[t][k]+1]++;
+        for (int i = 0; i < nVertices; i++)
+            first[i+1] += first[i];
+        fan.resize(first[nVertices]);
+        std::vector<int> next(first.begin(), first.end()-1);
+        for (size_t t = 0; t < mesh.triangles.size(); t++)
+            for (int k = 0; k < 3; k++)
+                fan[next[mesh.triangles[t][k]]++] = (int) t;
     }
-
-    void March() {
-        bool noabort;
-        while (cubes != NULL) {
-            // process active cubes till none left
-            CUBES *temp = cubes;
-            CUBE c = cubes->cube;
-            noabort =
-                // decompose into tetrahedra and polygonize
-                DoTet(&c, LBN, LTN, RBN, LBF) &&
-                DoTet(&c, RTN, LTN, LBF, RBN) &&
-                DoTet(&c, RTN, LTN, LTF, LBF) &&
-                DoTet(&c, RTN, RBN, LBF, RBF) &&
-                DoTet(&c, RTN, LBF, LTF, RBF) &&
-                DoTet(&c, RTN, LTF, RTF, RBF);
-            if (!noabort)
-                throw("aborted");
-            // pop current cube from stack
-            cubes = cubes->next;
-            free((char *) temp);
-            // test six face directions, maybe add to stack
-            TestFace(c.i-1, c.j, c.k, &c, L, LBN, LBF, LTN, LTF);
-            TestFace(c.i+1, c.j, c.k, &c, R, RBN, RBF, RTN, RTF);
-            TestFace(c.i, c.j-1, c.k, &c, B, LBN, LBF, RBN, RBF);
-            TestFace(c.i, c.j+1, c.k, &c, T, LTN, LTF, RTN, RTF);
-            TestFace(c.i, c.j, c.k-1, &c, N, LBN, LTN, RBN, RTN);
-            TestFace(c.i, c.j, c.k+1, &c, F, LBF, LTF, RBF, RTF);
-        }
-    } // end March
-
-    bool SetCenter(CENTERLIST *table[], int i, int j, int k)    {
-        // set (i,j,k) entry of table[]
-        // return true if already set; otherwise, set and return false
-        int index = HASH(i, j, k);
-        CENTERLIST *newCL, *l, *q = table[index];
-        for (l = q; l != NULL; l = l->next)
-        if (l->i == i && l->j == j && l->k == k)
-            return true;
-        newCL = (CENTERLIST *) mycalloc(1, sizeof(CENTERLIST)); // freed in FreeAll
-        newCL->i = i;
-        newCL->j = j;
-        newCL->k = k;
-        newCL->next = q;
-        table[index] = newCL;
-        return false;
+    template <class Fn> void ForFan(int v, Fn fn) {
+        // call fn(triangle id) for each live triangle of v
+        for (int m = v; m >= 0; m = member[m])
+            for (int f = first[m]; f < first[m+1]; f++)
+                if (alive[fan[f]])
+                    fn(fan[f]);
     }
-
-    void TestFace (int i, int j, int k, CUBE *old, int face, int c1, int c2, int c3, int c4) {
-        // given cube at lattice (i, j, k), and four corners of face,
-        // if surface crosses face, compute other four corners of adjacent cube
-        // and add new cube to cube stack
-        static int facebit[6] = {2, 2, 1, 1, 0, 0};
-        int pos = old->values[c1] > 0.0 ? 1 : 0, bit = facebit[face];
-        // test if no surface crossing, cube out of bounds, or already visited
-        if ((old->values[c2] > 0) == pos &&
-            (old->values[c3] > 0) == pos &&
-            (old->values[c4] > 0) == pos)
-            return;
-        if (abs(i) > bounds || abs(j) > bounds || abs(k) > bounds)
-            return;
-        if (SetCenter(centers, i, j, k))
-            return;
-        // create new_obj cube
-        CUBE c;
-        c.i = i;
-        c.j = j;
-        c.k = k;
-        int cids[] = {c1, c2, c3, c4};
-        for (int n = 0; n < 4; n++) {
-            int cid = cids[n];
-            c.values[FLIP(cid, bit)] = old->values[cid];
-            c.values[cid] = SetCorner(i+BIT(cid,2), j+BIT(cid,1), k+BIT(cid,0));
-        }
-        // add new cube to top of stack
-        CUBES *oldcubes = cubes;
-        cubes = (CUBES *) mycalloc(1, sizeof(CUBES)); // freed in March
-        cubes->cube = c;
-        cubes->next = oldcubes;
+    bool Manifold(int v) {
+        // each neighbor of v shares exactly two of its triangles (no boundary, no pinch);
+        // leaves neighbors marked with stamp
+        bool ok = true;
+        stamp++;
+        ForFan(v, [&](int t) {
+            for (int k = 0; k < 3; k++) {
+                int w = mesh.triangles[t][k];
+                if (w != v) {
+                    if (mark[w] != stamp) {
+                        mark[w] = stamp;
+                        count[w] = 0;
+                    }
+                    count[w]++;
+                }
+            }
+        });
+        ForFan(v, [&](int t) {
+            for (int k = 0; k < 3; k++)
+                if (mesh.triangles[t][k] != v && count[mesh.triangles[t][k]] != 2)
+                    ok = false;
+        });
+        return ok;
     }
-
-    float SetCorner (int i, int j, int k) {
-        // return corner with the given lattice location
-        // set (and cache) its function value; for speed, do corner value caching here
-        int index = HASH(i, j, k);
-        CORNERLIST *l = corners[index];
-        for (; l != NULL; l = l->next)
-            if (l->i == i && l->j == j && l->k == k)
-                return l->value;
-        l = (CORNERLIST *) mycalloc(1, sizeof(CORNERLIST)); // freed in FreeAll
-        l->i = i; l->j = j; l->k = k;
-        l->value = iProc(vec3((float)i*size, (float)j*size, (float)k*size));
-        l->next = corners[index];
-        corners[index] = l;
-        return l->value;
+    bool Folds(int v, int a, int b, const vec3 &p) {
+        // true if moving v to p flips a triangle of v that does not contain both a and b
+        bool folds = false;
+        ForFan(v, [&](int t) {
+            int3 &tri = mesh.triangles[t];
+            if ((tri.i1 == a || tri.i2 == a || tri.i3 == a) && (tri.i1 == b || tri.i2 == b || tri.i3 == b))
+                return;
+            vec3 q[3], r[3];
+            for (int k = 0; k < 3; k++) {
+                q[k] = mesh.points[tri[k]];
+                r[k] = tri[k] == v? p : q[k];
+            }
+            if (dot(cross(q[1]-q[0], q[2]-q[0]), cross(r[1]-r[0], r[2]-r[0])) < 0)
+                folds = true;
+        });
+        return folds;
     }
-
-    bool DoTet(CUBE* cube, int c1, int c2, int c3, int c4) {
-        // b, c, d should appear clockwise when viewed from a
-        // return false if client aborts, true otherwise
-        float a = cube->values[c1], b = cube->values[c2], c = cube->values[c3], d = cube->values[c4];
-        int index = 0, apos, bpos, cpos, dpos, e1 = 0, e2 = 0, e3 = 0, e4 = 0, e5 = 0, e6 = 0;
-        if ((apos = (a > 0.0))) index += 8;
-        if ((bpos = (b > 0.0))) index += 4;
-        if ((cpos = (c > 0.0))) index += 2;
-        if ((dpos = (d > 0.0))) index += 1;
-        // index is now 4-bit number representing one of the 16 possible cases
-        if (apos != bpos && (e1 = VertId(cube, c1, c2)) < 0)
-            return false;
-        if (apos != cpos && (e2 = VertId(cube, c1, c3)) < 0)
-            return false;
-        if (apos != dpos && (e3 = VertId(cube, c1, c4)) < 0)
-            return false;
-        if (bpos != cpos && (e4 = VertId(cube, c2, c3)) < 0)
+    bool Collapse(int a, int b) {
+        // merge b into a, if topology is preserved and no triangle flips
+        if (!Manifold(b))
             return false;
-        if (bpos != dpos && (e5 = VertId(cube, c2, c4)) < 0)
+        int bStamp = stamp, nCommon = 0;
+        stamp++;
+        ForFan(a, [&](int t) {
+            for (int k = 0; k < 3; k++) {
+                int w = mesh.triangles[t][k];
+                if (w != a && mark[w] == bStamp) {
+                    mark[w] = stamp;                // count each common neighbor once
+                    nCommon++;
+                }
+            }
+        });
+        // link condition: a and b share only the two vertices opposite their edge
+        if (nCommon != 2 || !Manifold(a))
             return false;
-        if (cpos != dpos && (e6 = VertId(cube, c3, c4)) < 0)
+        vec3 p = snapped[a]? mesh.points[a] : snapped[b]? mesh.points[b] : .5f*(mesh.points[a]+mesh.points[b]);
+        if (Folds(a, a, b, p) || Folds(b, a, b, p))
             return false;
-        // 14 productive tetrahedral cases (0000 and 1111 do not yield polygons
-        switch (index) {
-            case 1:  return tProc(e5, e6, e3);
-            case 2:  return tProc(e2, e6, e4);
-            case 3:  return tProc(e3, e5, e4) && tProc(e3, e4, e2);
-            case 4:  return tProc(e1, e4, e5);
-            case 5:  return tProc(e3, e1, e4) && tProc(e3, e4, e6);
-            case 6:  return tProc(e1, e2, e6) && tProc(e1, e6, e5);
-            case 7:  return tProc(e1, e2, e3);
-            case 8:  return tProc(e1, e3, e2);
-            case 9:  return tProc(e1, e5, e6) && tProc(e1, e6, e2);
-            case 10: return tProc(e1, e3, e6) && tProc(e1, e6, e4);
-            case 11: return tProc(e1, e5, e4);
-            case 12: return tProc(e3, e2, e4) && tProc(e3, e4, e5);
-            case 13: return tProc(e6, e2, e4);
-            case 14: return tProc(e5, e3, e6);
-        }
+        mesh.points[a] = p;
+        snapped[a] = snapped[a] || snapped[b];
+        mesh.normals[a] += mesh.normals[b];
+        ForFan(b, [&](int t) {
+            int3 &tri = mesh.triangles[t];
+            if (tri.i1 == a || tri.i2 == a || tri.i3 == a)
+                alive[t] = 0;
+            for (int k = 0; k < 3; k++)
+                if (tri[k] == b)
+                    tri[k] = a;
+        });
+        // append b's chain to a's
+        int m = a;
+        while (member[m] >= 0)
+            m = member[m];
+        member[m] = b;
         return true;
-    } // end dotet
-
-    void SetEdge(EDGELIST *table[], unsigned int i1, unsigned int j1, unsigned int k1, unsigned int i2, unsigned int j2, unsigned int k2, unsigned int vid) {
-        // set vertex id for edge
-        unsigned int index;
-        EDGELIST *newEL;
-        if ((i1>i2) || ((i1==i2) && ((j1>j2) || ((j1==j2) && (k1>k2))))) {
-            int t;
-            t=i1; i1=i2; i2=t;
-            t=j1; j1=j2; j2=t;
-            t=k1; k1=k2; k2=t;
-        }
-        index = HASH(i1, j1, k1) + HASH(i2, j2, k2);
-        newEL = (EDGELIST *) mycalloc(1, sizeof(EDGELIST)); // freed in FreeAll
-        newEL->i1 = i1; newEL->j1 = j1; newEL->k1 = k1;
-        newEL->i2 = i2; newEL->j2 = j2; newEL->k2 = k2;
-        newEL->vid = vid;
-        newEL->next = table[index];
-        table[index] = newEL;
     }
+};
 
-    int GetEdge(EDGELIST *table[], unsigned int i1, unsigned int j1, unsigned int k1, unsigned int i2, unsigned int j2, unsigned int k2) {
-        // return vertex id for edge; return -1 if not set
-        EDGELIST *q;
-        if ((i1>i2) || ((i1==i2) && ((j1>j2) || ((j1==j2) && (k1>k2))))) {
-            int t;
-            t=i1; i1=i2; i2=t;
-            t=j1; j1=j2; j2=t;
-            t=k1; k1=k2; k2=t;
-        };
-        q = table[HASH(i1, j1, k1)+HASH(i2, j2, k2)];
-        for (; q != NULL; q = q->next)
-            if (q->i1 == i1 && q->j1 == j1 && q->k1 == k1 &&
-                q->i2 == i2 && q->j2 == j2 && q->k2 == k2)
-                    return q->vid;
-        return -1;
-    }
+} // end namespace
 
-    int VertId(CUBE *c, int c1, int c2) {
-        // vertid: return index for vertex on edge:
-        // c1->value and c2->value are presumed of different sign
-        // return saved index if any; else compute vertex and save
-        int i1 = c->i+BIT(c1,2), j1 = c->j+BIT(c1,1), k1 = c->k+BIT(c1,0);
-        int i2 = c->i+BIT(c2,2), j2 = c->j+BIT(c2,1), k2 = c->k+BIT(c2,0);
-        int vid = GetEdge(edges, i1, j1, k1, i2, j2, k2);
-        if (vid != -1)
-            return vid;                          // previously computed
-        vec3 a((float)i1*size, (float)j1*size, (float)k1*size), v;
-        vec3 b((float)i2*size, (float)j2*size, (float)k2*size), n;
-        Converge(a, b, iProc(a), v);             // position
-        Normal(v, n, delta);                     // normal
-        vid = vProc(v, n);
-        SetEdge(edges, i1, j1, k1, i2, j2, k2, vid);
-        return vid;
-    }
+void CleanupStats::Print(FILE *out) const {
+    fprintf(out, "cleanup: %d snapped, %d collapsed; vertices %d -> %d, triangles %d -> %d (%.1f%% fewer)\n",
+        snapped, collapsed, verticesBefore, verticesAfter, trianglesBefore, trianglesAfter,
+        trianglesBefore? 100.f*(trianglesBefore-trianglesAfter)/trianglesBefore : 0.f);
+}
 
-    void Converge(vec3 &p1, vec3 &p2, float v, vec3 &p) {
-        int i = 0;
-        vec3 pos, neg;
-        if (v < 0) {
-            pos = p2;
-            neg = p1;
+CleanupStats Cleanup(PolyMesh &mesh, float cellSize, float tolerance) {
+    CleanupStats stats;
+    int nVertices = (int) mesh.points.size(), nTriangles = (int) mesh.triangles.size();
+    stats.verticesBefore = nVertices;
+    stats.trianglesBefore = nTriangles;
+    float minLength2 = tolerance*cellSize*tolerance*cellSize;
+    // move vertices near a lattice corner to it; edges between vertices at the same
+    // corner become zero length
+    std::vector<char> snapped(nVertices, 0);
+    std::vector<vec3> original(mesh.points);
+    for (int i = 0; i < nVertices; i++) {
+        vec3 &p = mesh.points[i];
+        vec3 q((float) floor(p.x/cellSize+.5f)*cellSize, (float) floor(p.y/cellSize+.5f)*cellSize, (float) floor(p.z/cellSize+.5f)*cellSize);
+        if (dot(p-q, p-q) < minLength2) {
+            p = q;
+            snapped[i] = 1;
         }
-        else {
-            pos = p1;
-            neg = p2;
+    }
+    // collapse short edges; a collapse can shorten others, so repeat while any collapse
+    Collapser c(mesh, snapped);
+    for (int pass = 0, n = 1; n > 0 && pass < 4; pass++) {
+        n = 0;
+        for (int t = 0; t < nTriangles; t++)
+            for (int e = 0; e < 3 && c.alive[t]; e++) {
+                int a = mesh.triangles[t][e], b = mesh.triangles[t][(e+1)%3];
+                vec3 d = mesh.points[a]-mesh.points[b];
+                if (dot(d, d) < minLength2 && c.Collapse(a, b))
+                    n++;
+            }
+        stats.collapsed += n;
+    }
+    // drop collapsed triangles, renumber referenced vertices in original order
+    std::vector<int> id(nVertices, -1);
+    int nKept = 0;
+    for (int t = 0; t < nTriangles; t++)
+        if (c.alive[t]) {
+            int3 tri = mesh.triangles[t];
+            id[tri.i1] = id[tri.i2] = id[tri.i3] = 0;
+            mesh.triangles[nKept++] = tri;
         }
-        while (1) {
-            p = 0.5f*(pos+neg);
-            if (i++ == RES)
-                return;
-            if ((iProc(p)) > 0.0)
-                 pos = p;
-            else neg = p;
+    mesh.triangles.resize(nKept);
+    // vertices left at a shared corner (where collapse would change topology) return to
+    // their original positions
+    std::unordered_map<long long, int> atCorner;
+    for (int i = 0; i < nVertices; i++)
+        if (id[i] == 0 && snapped[i]) {
+            vec3 &p = mesh.points[i];
+            atCorner[PolygonizerDetail::LatticeKey((int) floor(p.x/cellSize+.5f), (int) floor(p.y/cellSize+.5f), (int) floor(p.z/cellSize+.5f))]++;
         }
+    int nUsed = 0;
+    for (int i = 0; i < nVertices; i++)
+        if (id[i] == 0) {
+            vec3 p = mesh.points[i], n = mesh.normals[i];
+            if (snapped[i]) {
+                if (atCorner[PolygonizerDetail::LatticeKey((int) floor(p.x/cellSize+.5f), (int) floor(p.y/cellSize+.5f), (int) floor(p.z/cellSize+.5f))] > 1)
+                    p = original[i];
+                else
+                    stats.snapped++;
+            }
+            float len = length(n);
+            id[i] = nUsed;
+            mesh.points[nUsed] = p;
+            mesh.normals[nUsed++] = len > 0? n/len : n;
+        }
+    mesh.points.resize(nUsed);
+    mesh.normals.resize(nUsed);
+    for (int t = 0; t < nKept; t++) {
+        int3 &tri = mesh.triangles[t];
+        tri = int3(id[tri.i1], id[tri.i2], id[tri.i3]);
     }
+    stats.verticesAfter = nUsed;
+    stats.trianglesAfter = nKept;
+    return stats;
+}
+
+// Streaming Output
+
+namespace {
+
+const char *plyHeader =
+    "ply\n"
+    "format binary_little_endian 1.0\n"
+    "element vertex %10d\n"
+    "property float x\nproperty float y\nproperty float z\n"
+    "property float nx\nproperty float ny\nproperty float nz\n"
+    "element face %10d\n"
+    "property list uchar int vertex_indices\n"
+    "end_header\n";
 
-    void Normal(vec3 &p, vec3 &n, float delta) {
-        float f = iProc(p);
-        n.x = iProc(vec3(p.x+delta, p.y, p.z))-f;
-        n.y = iProc(vec3(p.x, p.y+delta, p.z))-f;
-        n.z = iProc(vec3(p.x, p.y, p.z+delta))-f;
-        n = normalize(n);
+} // end namespace
+
+bool StreamWriter::Open(const char *filename) {
+    Close();
+    size_t len = strlen(filename);
+    stl = len > 4 && (!strcmp(filename+len-4, ".stl") || !strcmp(filename+len-4, ".STL"));
+    file = fopen(filename, "wb");
+    if (!file)
+        return false;
+    nVertices = nTriangles = base = slabStart = 0;
+    points.resize(0);
+    ok = true;
+    if (stl) {
+        char header[80] = "binary STL from Polygonizer";
+        unsigned int count = 0;
+        ok = fwrite(header, 80, 1, file) == 1 && fwrite(&count, 4, 1, file) == 1;
     }
+    else {
+        faces = tmpfile();
+        ok = faces != NULL && fprintf(file, plyHeader, 0, 0) > 0;
+    }
+    return ok;
+}
 
-    Process(ImplicitProc i, VertexProc v, TriangleProc t, float s, float d, int b) :
-        iProc(i), vProc(v), tProc(t), size(s), delta(d), bounds(b) {
-        // allocate hash tables, freed in FreeAll
-        centers = (CENTERLIST **) mycalloc(HASHSIZE, sizeof(CENTERLIST *));
-        corners = (CORNERLIST **) mycalloc(HASHSIZE, sizeof(CORNERLIST *));
-        edges = (EDGELIST **) mycalloc(2*HASHSIZE, sizeof(EDGELIST *));
-        cubes = NULL;
+int StreamWriter::Vertex(const vec3 &p, const vec3 &n) {
+    if (stl)
+        points.push_back(p);
+    else {
+        float v[] = {p.x, p.y, p.z, n.x, n.y, n.z};
+        ok = ok && fwrite(v, sizeof(v), 1, file) == 1;
     }
+    return nVertices++;
+}
 
-    ~Process() {
-        FreeAll();
+bool StreamWriter::Triangle(int i1, int i2, int i3) {
+    if (stl) {
+        if (i1 < base || i2 < base || i3 < base)
+            return false;       // vertex no longer held
+        vec3 &p1 = points[i1-base], &p2 = points[i2-base], &p3 = points[i3-base];
+        vec3 n = cross(p2-p1, p3-p1);
+        float l = length(n);
+        if (l > 0)
+            n = n/l;
+        float t[] = {n.x, n.y, n.z, p1.x, p1.y, p1.z, p2.x, p2.y, p2.z, p3.x, p3.y, p3.z};
+        unsigned short attribute = 0;
+        ok = ok && fwrite(t, sizeof(t), 1, file) == 1 && fwrite(&attribute, 2, 1, file) == 1;
     }
-}; // end Process
+    else {
+        unsigned char nIds = 3;
+        int ids[] = {i1, i2, i3};
+        ok = ok && fwrite(&nIds, 1, 1, faces) == 1 && fwrite(ids, sizeof(ids), 1, faces) == 1;
+    }
+    nTriangles++;
+    return ok;
+}
 
-} // end namespace
+void StreamWriter::EndSlab() {
+    // subsequent triangles refer only to vertices from this slab or later
+    if (stl && slabStart > base) {
+        points.erase(points.begin(), points.begin()+(slabStart-base));
+        base = slabStart;
+    }
+    slabStart = nVertices;
+}
 
-void Polygonize(std::vector<vec3> &starts, float cellSize, int bounds,
-                ImplicitProc iProc,
-                VertexProc vProc,
-                TriangleProc tProc) {
-    Process p(iProc, vProc, tProc, cellSize, cellSize/(float)(RES*RES), bounds);
-    for (size_t i = 0; i < starts.size(); i++)
-        p.AddToStack(starts[i]);
-    p.March();
+bool StreamWriter::Close() {
+    if (!file)
+        return ok;
+    if (stl) {
+        unsigned int count = nTriangles;
+        ok = ok && fseek(file, 80, SEEK_SET) == 0 && fwrite(&count, 4, 1, file) == 1;
+    }
+    else if (faces) {
+        // append faces, then rewrite header with counts (same length as placeholder)
+        char buf[1<<16];
+        rewind(faces);
+        for (size_t n; ok && (n = fread(buf, 1, sizeof(buf), faces)) > 0; )
+            ok = fwrite(buf, 1, n, file) == n;
+        ok = ok && fseek(file, 0, SEEK_SET) == 0 && fprintf(file, plyHeader, nVertices, nTriangles) > 0;
+        fclose(faces);
+    }
+    ok = fclose(file) == 0 && ok;
+    file = faces = NULL;
+    points.resize(0);
+    return ok;
 }
 
-void Polygonize(vec3 &start, float cellSize, int bounds,
-                ImplicitProc &iProc,
-                VertexProc &vProc,
-                TriangleProc &tProc) {
-    std::vector<vec3> starts(1, start);
-    Polygonize(starts, cellSize, bounds,
-        iProc,
-        vProc,
-        tProc);
+bool PolygonizeToFile(const char *filename, float cellSize, int bounds,
+                      ImplicitProc iProc,
+                      GradientProc gProc,
+                      int slabDepth,
+                      int coarse,
+                      PolygonizeStats *stats) {
+    StreamWriter writer;
+    if (!writer.Open(filename))
+        return false;
+    ProcField field = {iProc};
+    ProcGradient gradient = {gProc};
+    try {
+        if (!PolygonizeSlabs(cellSize, bounds, field, writer, gradient, slabDepth, coarse, stats)) {
+            writer.Close();
+            return false;
+        }
+    }
+    catch (const char *) {     // allocation failure
+        writer.Close();
+        return false;
+    }
+    return writer.Close();
 }
@@ -0,0 +1,400 @@
+// PolygonizerGPU.cpp - marching tetrahedra in compute shaders
+
+#include <glad.h>
+#include <string>
+#include "GLXtras.h"
+#include "PolygonizerGPU.h"
+
+namespace {
+
+const int BLOCK = 1024;                 // elements scanned per workgroup (256 threads, 4 each)
+const int MAXGROUPS = 65535;            // per dispatch dimension, guaranteed by GL 4.3
+const int MAXPOINTS = 1<<26;            // so scan blocks fit one dispatch
+
+// Shaders
+
+const char *header = R"(
+    #version 430
+    uniform vec3 origin;
+    uniform float cellSize;
+    uniform ivec3 res;                  // cells per axis; lattice points are res+1
+    uniform int converge;
+    layout(std430, binding = 0) buffer Values { float values[]; };
+    layout(std430, binding = 1) buffer Counts { uvec2 counts[]; };     // vertices, triangles
+    layout(std430, binding = 2) buffer Vertices { vec4 vertices[]; };  // position, normal
+    layout(std430, binding = 3) buffer Indices { uint indices[]; };
+)";
+
+const char *lattice = R"(
+    int Index(ivec3 p) { return (p.z*(res.y+1)+p.y)*(res.x+1)+p.x; }
+    vec3 Location(ivec3 p) { return origin+cellSize*vec3(p); }
+    bool InBrick(ivec3 p) { return all(greaterThanEqual(p, ivec3(0))) && all(lessThanEqual(p, res)); }
+    bool Positive(ivec3 p) { return values[Index(p)] > 0; }
+    // cube corners as in PolygonizerT.h: bit 2 is x, bit 1 is y, bit 0 is z
+    ivec3 Corner(int c) { return ivec3((c>>2)&1, (c>>1)&1, c&1); }
+    // every tetrahedron edge is a lattice edge in one of these directions, owned by the
+    // lattice point at its start
+    const ivec3 dirs[7] = ivec3[7](ivec3(1, 0, 0), ivec3(0, 1, 0), ivec3(0, 0, 1),
+        ivec3(1, -1, 0), ivec3(1, 0, -1), ivec3(0, 1, -1), ivec3(1, 1, -1));
+    // the tetrahedra of Process::DoCube; b, c, d clockwise viewed from a
+    const ivec4 tets[6] = ivec4[6](ivec4(0, 2, 4, 1), ivec4(6, 2, 1, 4), ivec4(6, 2, 3, 1),
+        ivec4(6, 4, 1, 5), ivec4(6, 1, 3, 5), ivec4(6, 3, 7, 5));
+    uint EdgeMask(ivec3 p) {
+        // bit e set if edge e from p crosses the surface
+        bool s = Positive(p);
+        uint mask = 0u;
+        for (int e = 0; e < 7; e++) {
+            ivec3 q = p+dirs[e];
+            if (InBrick(q) && Positive(q) != s)
+                mask |= 1u<<e;
+        }
+        return mask;
+    }
+    uint TetIndex(ivec3 p, ivec4 t) {
+        // 4-bit case number as in Process::DoTet
+        return (Positive(p+Corner(t.x))? 8u : 0u)+(Positive(p+Corner(t.y))? 4u : 0u)+
+               (Positive(p+Corner(t.z))? 2u : 0u)+(Positive(p+Corner(t.w))? 1u : 0u);
+    }
+    uint NTriangles(uint index) {
+        // per tetrahedron case, two bits: 0, 1, 1, 2, 1, 2, 2, 1, 1, 2, 2, 1, 2, 1, 1, 0
+        return (0x16696994u>>(2u*index))&3u;
+    }
+)";
+
+const char *sampleShader = R"(
+    layout(local_size_x = 4, local_size_y = 4, local_size_z = 4) in;
+    void main() {
+        ivec3 p = ivec3(gl_GlobalInvocationID);
+        if (InBrick(p))
+            values[Index(p)] = field(Location(p));
+    }
+)";
+
+const char *countShader = R"(
+    layout(local_size_x = 4, local_size_y = 4, local_size_z = 4) in;
+    void main() {
+        ivec3 p = ivec3(gl_GlobalInvocationID);
+        if (!InBrick(p))
+            return;
+        uint nt = 0u;
+        if (all(lessThan(p, res)))
+            for (int t = 0; t < 6; t++)
+                nt += NTriangles(TetIndex(p, tets[t]));
+        counts[Index(p)] = uvec2(bitCount(EdgeMask(p)), nt);
+    }
+)";
+
+const char *emitShader = R"(
+    layout(local_size_x = 4, local_size_y = 4, local_size_z = 4) in;
+    vec3 Converge(ivec3 ia, ivec3 ib) {
+        // false position between lattice points of opposite sign
+        vec3 a = Location(ia), b = Location(ib);
+        float va = values[Index(ia)], vb = values[Index(ib)];
+        vec3 p = a+(va/(va-vb))*(b-a);
+        for (int i = 0; i < converge; i++) {
+            float v = field(p);
+            if ((v > 0) == (va > 0)) { a = p; va = v; }
+            else { b = p; vb = v; }
+            p = va == vb? .5*(a+b) : a+(va/(va-vb))*(b-a);
+        }
+        return p;
+    }
+    vec3 Normal(vec3 p) {
+        // central difference, delta as in Polygonize (cellSize/(RES*RES), RES = 9)
+        float d = cellSize/81.;
+        vec3 n = vec3(field(p+vec3(d, 0, 0))-field(p-vec3(d, 0, 0)),
+                      field(p+vec3(0, d, 0))-field(p-vec3(0, d, 0)),
+                      field(p+vec3(0, 0, d))-field(p-vec3(0, 0, d)));
+        return dot(n, n) > 0? normalize(n) : vec3(0);
+    }
+    uint VertId(ivec3 a, ivec3 b) {
+        // index of the vertex on lattice edge a-b: the owning point's offset, plus the
+        // number of crossed edges it owns that precede this one
+        ivec3 d = b-a;
+        if (d.x < 0 || (d.x == 0 && (d.y < 0 || (d.y == 0 && d.z < 0))))
+            a = b;                      // owner is the end whose first nonzero step is positive
+        // edge number by which axes d spans (as nibbles: xyz bits 001 is edge 2, 010 is 1, ...)
+        uint axes = (d.x != 0? 4u : 0u)+(d.y != 0? 2u : 0u)+(d.z != 0? 1u : 0u);
+        uint e = (0x63405120u>>(4u*axes))&15u;
+        return counts[Index(a)].x+bitCount(EdgeMask(a)&((1u<<e)-1u));
+    }
+    void Triangle(inout uint n, uint i1, uint i2, uint i3) {
+        indices[3*n] = i1;
+        indices[3*n+1] = i2;
+        indices[3*n+2] = i3;
+        n++;
+    }
+    void main() {
+        ivec3 p = ivec3(gl_GlobalInvocationID);
+        if (!InBrick(p))
+            return;
+        uvec2 offset = counts[Index(p)];
+        // vertices on owned edges
+        uint mask = EdgeMask(p), nv = offset.x;
+        for (int e = 0; e < 7; e++)
+            if ((mask & (1u<<e)) != 0u) {
+                vec3 v = Converge(p, p+dirs[e]);
+                vertices[2*nv] = vec4(v, 1);
+                vertices[2*nv+1] = vec4(Normal(v), 0);
+                nv++;
+            }
+        // triangles in cell, unless none; cases as in Process::DoTet
+        if (any(greaterThanEqual(p, res)) || counts[Index(p)+1].y == offset.y)
+            return;
+        uint nt = offset.y;
+        for (int t = 0; t < 6; t++) {
+            ivec4 c = tets[t];
+            uint index = TetIndex(p, c);
+            if (NTriangles(index) == 0u)
+                continue;
+            ivec3 c1 = p+Corner(c.x), c2 = p+Corner(c.y), c3 = p+Corner(c.z), c4 = p+Corner(c.w);
+            bool apos = (index&8u) != 0u, bpos = (index&4u) != 0u, cpos = (index&2u) != 0u, dpos = (index&1u) != 0u;
+            uint e1 = apos != bpos? VertId(c1, c2) : 0u, e2 = apos != cpos? VertId(c1, c3) : 0u;
+            uint e3 = apos != dpos? VertId(c1, c4) : 0u, e4 = bpos != cpos? VertId(c2, c3) : 0u;
+            uint e5 = bpos != dpos? VertId(c2, c4) : 0u, e6 = cpos != dpos? VertId(c3, c4) : 0u;
+            switch (index) {
+                case 1:  Triangle(nt, e5, e6, e3); break;
+                case 2:  Triangle(nt, e2, e6, e4); break;
+                case 3:  Triangle(nt, e3, e5, e4); Triangle(nt, e3, e4, e2); break;
+                case 4:  Triangle(nt, e1, e4, e5); break;
+                case 5:  Triangle(nt, e3, e1, e4); Triangle(nt, e3, e4, e6); break;
+                case 6:  Triangle(nt, e1, e2, e6); Triangle(nt, e1, e6, e5); break;
+                case 7:  Triangle(nt, e1, e2, e3); break;
+                case 8:  Triangle(nt, e1, e3, e2); break;
+                case 9:  Triangle(nt, e1, e5, e6); Triangle(nt, e1, e6, e2); break;
+                case 10: Triangle(nt, e1, e3, e6); Triangle(nt, e1, e6, e4); break;
+                case 11: Triangle(nt, e1, e5, e4); break;
+                case 12: Triangle(nt, e3, e2, e4); Triangle(nt, e3, e4, e5); break;
+                case 13: Triangle(nt, e6, e2, e4); break;
+                case 14: Triangle(nt, e5, e3, e6); break;
+            }
+        }
+    }
+)";
+
+// exclusive prefix sum of uvec2 counts, in blocks of 1024; block totals are written to
+// sums, scanned in turn, and added back
+const char *scanShader = R"(
+    #version 430
+    layout(local_size_x = 256) in;
+    layout(std430, binding = 0) buffer Data { uvec2 data[]; };
+    layout(std430, binding = 1) buffer Sums { uvec2 sums[]; };
+    uniform int n;
+    shared uvec2 partial[256];
+    void main() {
+        uint t = gl_LocalInvocationID.x, base = gl_WorkGroupID.x*1024u+4u*t;
+        uvec2 v[4], sum = uvec2(0);
+        for (uint i = 0u; i < 4u; i++) {
+            v[i] = base+i < uint(n)? data[base+i] : uvec2(0);
+            sum += v[i];
+        }
+        partial[t] = sum;
+        barrier();
+        for (uint d = 1u; d < 256u; d *= 2u) {
+            uvec2 add = t >= d? partial[t-d] : uvec2(0);
+            barrier();
+            partial[t] += add;
+            barrier();
+        }
+        uvec2 run = partial[t]-sum;
+        for (uint i = 0u; i < 4u; i++) {
+            if (base+i < uint(n))
+                data[base+i] = run;
+            run += v[i];
+        }
+        if (t == 255u)
+            sums[gl_WorkGroupID.x] = partial[255];
+    }
+)";
+
+const char *addShader = R"(
+    #version 430
+    layout(local_size_x = 256) in;
+    layout(std430, binding = 0) buffer Data { uvec2 data[]; };
+    layout(std430, binding = 1) buffer Sums { uvec2 sums[]; };
+    uniform int n;
+    void main() {
+        uint b = gl_WorkGroupID.x;
+        for (uint i = gl_LocalInvocationID.x; i < 1024u; i += 256u)
+            if (b*1024u+i < uint(n))
+                data[b*1024u+i] += sums[b];
+    }
+)";
+
+GLuint Link(const std::string &code) {
+    const char *c = code.c_str();
+    GLuint program = LinkProgramViaCode(&c);
+    GLint status = GL_FALSE;
+    if (program)
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE && program) {
+        glDeleteProgram(program);
+        program = 0;
+    }
+    return program;
+}
+
+void Resize(GLuint buffer, int &capacity, int size) {
+    // grow, never shrink
+    if (size > capacity) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, size, NULL, GL_DYNAMIC_COPY);
+        capacity = size;
+    }
+}
+
+void Dispatch(GLuint program, const int3 &res) {
+    // one invocation per lattice point
+    glUseProgram(program);
+    glDispatchCompute((res.i1+4)/4, (res.i2+4)/4, (res.i3+4)/4);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+} // end namespace
+
+bool PolygonizerGPU::Init(const char *fieldCode) {
+    Release();
+    std::string common = std::string(header)+fieldCode+"\n"+lattice;
+    sampleProgram = Link(common+sampleShader);
+    countProgram = Link(common+countShader);
+    emitProgram = Link(common+emitShader);
+    scanProgram = Link(scanShader);
+    addProgram = Link(addShader);
+    if (!sampleProgram || !countProgram || !emitProgram || !scanProgram || !addProgram) {
+        Release();
+        return false;
+    }
+    glGenBuffers(1, &values);
+    glGenBuffers(1, &counts);
+    glGenBuffers(1, &vBuffer);
+    glGenBuffers(1, &iBuffer);
+    return true;
+}
+
+void PolygonizerGPU::Release() {
+    GLuint programs[] = {sampleProgram, countProgram, scanProgram, addProgram, emitProgram};
+    for (int i = 0; i < 5; i++)
+        if (programs[i])
+            glDeleteProgram(programs[i]);
+    GLuint buffers[] = {values, counts, vBuffer, iBuffer};
+    for (int i = 0; i < 4; i++)
+        if (buffers[i])
+            glDeleteBuffers(1, &buffers[i]);
+    if (sums.size())
+        glDeleteBuffers((GLsizei) sums.size(), sums.data());
+    if (vao)
+        glDeleteVertexArrays(1, &vao);
+    sampleProgram = countProgram = scanProgram = addProgram = emitProgram = 0;
+    values = counts = vBuffer = iBuffer = vao = 0;
+    sums.resize(0);
+    nPoints = nVertices = nTriangles = vCapacity = iCapacity = 0;
+}
+
+void PolygonizerGPU::Scan(GLuint data, int n, int level) {
+    int nBlocks = (n+BLOCK-1)/BLOCK;
+    if ((int) sums.size() <= level) {
+        GLuint b;
+        glGenBuffers(1, &b);
+        sums.push_back(b);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sums[level]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, nBlocks*2*sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, data);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, sums[level]);
+    glUseProgram(scanProgram);
+    SetUniform(scanProgram, "n", n);
+    glDispatchCompute(nBlocks, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    if (nBlocks == 1) {
+        // block total is the grand total
+        GLuint totals[2];
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, sums[level]);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(totals), totals);
+        nVertices = (int) totals[0];
+        nTriangles = (int) totals[1];
+        return;
+    }
+    Scan(sums[level], nBlocks, level+1);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, data);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, sums[level]);
+    glUseProgram(addProgram);
+    SetUniform(addProgram, "n", n);
+    glDispatchCompute(nBlocks, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+bool PolygonizerGPU::Polygonize(const vec3 &min, float cellSize, const int3 &res, int converge) {
+    nVertices = nTriangles = 0;
+    if (!sampleProgram || res.i1 < 1 || res.i2 < 1 || res.i3 < 1)
+        return false;
+    double n = (double) (res.i1+1)*(res.i2+1)*(res.i3+1);
+    if (n > MAXPOINTS || res.i1 >= MAXGROUPS*4 || res.i2 >= MAXGROUPS*4 || res.i3 >= MAXGROUPS*4)
+        return false;
+    int program = CurrentProgram();
+    if ((int) n > nPoints) {
+        nPoints = (int) n;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, values);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, nPoints*sizeof(float), NULL, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, counts);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, nPoints*2*sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+    }
+    GLuint lattice[] = {sampleProgram, countProgram, emitProgram};
+    for (int i = 0; i < 3; i++) {
+        glUseProgram(lattice[i]);
+        SetUniform(lattice[i], "origin", min, false);          // unused uniforms are optimized out
+        SetUniform(lattice[i], "cellSize", cellSize, false);
+        SetUniform(lattice[i], "converge", converge, false);
+        glUniform3i(glGetUniformLocation(lattice[i], "res"), res.i1, res.i2, res.i3);
+    }
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, values);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, counts);
+    Dispatch(sampleProgram, res);
+    Dispatch(countProgram, res);
+    Scan(counts, (int) n, 0);
+    // size output (vertex and index buffers double as VBO and IBO)
+    Resize(vBuffer, vCapacity, nVertices*8*sizeof(float));
+    Resize(iBuffer, iCapacity, nTriangles*3*sizeof(GLuint));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, values);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, counts);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, vBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, iBuffer);
+    if (nTriangles)
+        Dispatch(emitProgram, res);
+    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_ELEMENT_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    glUseProgram(program);
+    return true;
+}
+
+void PolygonizerGPU::Draw(GLuint program, const char *pointName, const char *normalName) {
+    if (!nTriangles)
+        return;
+    if (!vao)
+        glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, iBuffer);
+    glUseProgram(program);
+    VertexAttribPointer(program, pointName, 3, 8*sizeof(float), (void *) 0);
+    VertexAttribPointer(program, normalName, 3, 8*sizeof(float), (void *) (4*sizeof(float)));
+    glDrawElements(GL_TRIANGLES, 3*nTriangles, GL_UNSIGNED_INT, 0);
+    glBindVertexArray(0);
+}
+
+bool PolygonizerGPU::Read(PolyMesh &mesh) {
+    mesh.Clear();
+    if (!nTriangles)
+        return false;
+    std::vector<vec4> v(2*nVertices);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, vBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, v.size()*sizeof(vec4), v.data());
+    mesh.points.resize(nVertices);
+    mesh.normals.resize(nVertices);
+    for (int i = 0; i < nVertices; i++) {
+        mesh.points[i] = vec3(v[2*i].x, v[2*i].y, v[2*i].z);
+        mesh.normals[i] = vec3(v[2*i+1].x, v[2*i+1].y, v[2*i+1].z);
+    }
+    mesh.triangles.resize(nTriangles);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, iBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, nTriangles*sizeof(int3), mesh.triangles.data());
+    return true;
+}
@@ -1,10 +1,13 @@
 // Quaternion.cpp - quaternion rep & op
 
+#include <algorithm>
 #include <float.h>
+#include <math.h>
+#include <string.h>
 #include "Quaternion.h"
 
 const int X = 0, Y = 1, Z = 2;
-#define _PI 3.141592f
+const float Pi = 3.14159265f;
 
 Quaternion::Quaternion(vec3 axis, float radAng) {
     float c = cos(radAng/2), s = sin(radAng/2);
@@ -51,7 +54,7 @@ Quaternion::Quaternion(mat3 &mat) {
   }
 }
 
-mat3 Quaternion::Get3x3() {
+mat3 Quaternion::Get3x3() const {
     float norm = Norm();
     if (fabs(norm) < FLT_EPSILON)
         return mat3(vec3(1, 0, 0), vec3(0, 1, 0), vec3(0, 0, 1));
@@ -66,14 +69,14 @@ mat3 Quaternion::Get3x3() {
         vec3(xz + wy,       yz - wx,       1 - (xx + yy)));
 }
 
-mat4 Quaternion::GetMatrix() {
+mat4 Quaternion::GetMatrix() const {
     mat3 m3 = Get3x3();
     return mat4(m3);
 }
 
-float Dot(Quaternion &qL, Quaternion &qR) { return qL.x*qR.x + qL.y*qR.y + qL.z*qR.z + qL.w*qR.w; }
+float Dot(const Quaternion &qL, const Quaternion &qR) { return qL.x*qR.x + qL.y*qR.y + qL.z*qR.z + qL.w*qR.w; }
 
-void Quaternion::Slerp(Quaternion& qu0, Quaternion& qu1, float t) {
+void Quaternion::Slerp(const Quaternion &qu0, const Quaternion &qu1, float t) {
   float qu0Part, qu1Part, epsilon = .00001f;
   float cosOmega = Dot(qu0, qu1);
   if ((1 + cosOmega) > epsilon) { // usual case
@@ -92,13 +95,222 @@ void Quaternion::Slerp(Quaternion& qu0, Quaternion& qu1, float t) {
   }
   else { // ends nearly opposite
     Quaternion qup(-qu0.y, qu0.x, -qu0.w, qu0.z);
-    qu0Part = sin((0.5f - t)*_PI);
-    qu1Part = sin(t*_PI);
+    qu0Part = sin((0.5f - t)*Pi);
+    qu1Part = sin(t*Pi);
     Quaternion s1 = qu0*qu0Part, s2 = qup*qu1Part;
     *this = s1+s2;
   }
 }
 
+// QuaternionArray
+
+namespace {
+
+const int CHUNK = 16;                   // floats per chunk; streams are padded to this
+
+} // end namespace
+
+QuaternionArray::QuaternionArray(const std::vector<Quaternion> &q) {
+    Resize(q.size());
+    for (size_t i = 0; i < q.size(); i++)
+        Set(i, q[i]);
+}
+
+void QuaternionArray::Resize(size_t n) {
+    size_t p = (n+CHUNK-1)/CHUNK*CHUNK;
+    std::vector<float> *streams[] = {&x, &y, &z, &w};
+    for (int s = 0; s < 4; s++) {
+        std::vector<float> &v = *streams[s];
+        if (n < size)
+            std::fill(v.begin()+n, v.begin()+size, 0.f);
+        v.resize(p, 0.f);
+    }
+    size = n;
+}
+
+void QuaternionArray::Store(std::vector<Quaternion> &q) const {
+    q.resize(size);
+    for (size_t i = 0; i < size; i++)
+        q[i] = Get(i);
+}
+
+// Kernels
+
+// as in Vec3Array.cpp, the streams are processed CHUNK floats at a time: a chunk kernel
+// computes into restrict-qualified buffers (so compilers vectorize without alias checks),
+// which are then copied to the result (which may be an argument)
+
+namespace {
+
+struct Chunk {
+    // one chunk of the arguments
+    const float *x0, *y0, *z0, *w0, *x1, *y1, *z1, *w1, *t;
+};
+
+void NormalizeChunk(float *__restrict x, float *__restrict y, float *__restrict z, float *__restrict w) {
+    // zero quaternions (as the padding) are left zero
+#ifdef VECMAT_SSE
+    // sqrtf may set errno, which keeps compilers from vectorizing it
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1);
+    for (int j = 0; j < CHUNK; j += 4) {
+        __m128 vx = _mm_loadu_ps(x+j), vy = _mm_loadu_ps(y+j), vz = _mm_loadu_ps(z+j), vw = _mm_loadu_ps(w+j);
+        __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)),
+                              _mm_add_ps(_mm_mul_ps(vz, vz), _mm_mul_ps(vw, vw)));
+        __m128 s = _mm_and_ps(_mm_cmpgt_ps(d, zero), _mm_div_ps(one, _mm_sqrt_ps(d)));
+        _mm_storeu_ps(x+j, _mm_mul_ps(vx, s));
+        _mm_storeu_ps(y+j, _mm_mul_ps(vy, s));
+        _mm_storeu_ps(z+j, _mm_mul_ps(vz, s));
+        _mm_storeu_ps(w+j, _mm_mul_ps(vw, s));
+    }
+#else
+    for (int j = 0; j < CHUNK; j++) {
+        float d = x[j]*x[j]+y[j]*y[j]+z[j]*z[j]+w[j]*w[j];
+        float s = d > 0? 1.f/sqrtf(d) : 0;
+        x[j] *= s;
+        y[j] *= s;
+        z[j] *= s;
+        w[j] *= s;
+    }
+#endif
+}
+
+void NlerpChunk(const Chunk &c, float *__restrict x, float *__restrict y, float *__restrict z, float *__restrict w) {
+    for (int j = 0; j < CHUNK; j++) {
+        float d = c.x0[j]*c.x1[j]+c.y0[j]*c.y1[j]+c.z0[j]*c.z1[j]+c.w0[j]*c.w1[j];
+        float t = c.t[j], f0 = 1-t, f1 = d < 0? -t : t;
+        x[j] = f0*c.x0[j]+f1*c.x1[j];
+        y[j] = f0*c.y0[j]+f1*c.y1[j];
+        z[j] = f0*c.z0[j]+f1*c.z1[j];
+        w[j] = f0*c.w0[j]+f1*c.w1[j];
+    }
+    NormalizeChunk(x, y, z, w);
+}
+
+// sin(t*a)/sin(a), for a = acos(d) in [0, pi/2], is t*(1+sum over i of b[i]*(d-1)^i), where
+// b[i] = b[i-1]*(t*t-i*i)/(i*(2i+1)) and b[0] = 1 (Eberly, "A Fast and Accurate Algorithm
+// for Computing SLERP"); the sum is evaluated as nested products 1+(v[i]-u[i]*t*t)*(1-d)*(...),
+// truncated at TERMS terms with the last scaled by mu, then multiplied by t; the result is
+// within 3e-8 of the ratio
+
+const int TERMS = 16;
+const double mu = 1.916666;             // minimizes the error for 16 terms
+
+struct SlerpCoefficients {
+    float u[TERMS], v[TERMS];
+    SlerpCoefficients() {
+        for (int i = 1; i <= TERMS; i++) {
+            double m = i == TERMS? mu : 1;
+            u[i-1] = (float) (m/(i*(2*i+1)));
+            v[i-1] = (float) (m*i/(2*i+1));
+        }
+    }
+} coefficients;
+
+void SlerpChunk(const Chunk &c, float *__restrict x, float *__restrict y, float *__restrict z, float *__restrict w) {
+    // the series is summed term by term across the chunk, so each loop vectorizes
+    float d[CHUNK], e[CHUNK], s0[CHUNK], s1[CHUNK], f0[CHUNK], f1[CHUNK];
+    for (int j = 0; j < CHUNK; j++) {
+        d[j] = c.x0[j]*c.x1[j]+c.y0[j]*c.y1[j]+c.z0[j]*c.z1[j]+c.w0[j]*c.w1[j];
+        e[j] = 1-(d[j] < 0? -d[j] : d[j]);
+        s0[j] = (1-c.t[j])*(1-c.t[j]);
+        s1[j] = c.t[j]*c.t[j];
+        f0[j] = f1[j] = 1;
+    }
+    for (int i = TERMS-1; i >= 0; i--) {
+        float u = coefficients.u[i], v = coefficients.v[i];
+        for (int j = 0; j < CHUNK; j++) {
+            f0[j] = 1+(v-u*s0[j])*e[j]*f0[j];
+            f1[j] = 1+(v-u*s1[j])*e[j]*f1[j];
+        }
+    }
+    for (int j = 0; j < CHUNK; j++) {
+        float a0 = (1-c.t[j])*f0[j], a1 = c.t[j]*f1[j];
+        a1 = d[j] < 0? -a1 : a1;
+        x[j] = a0*c.x0[j]+a1*c.x1[j];
+        y[j] = a0*c.y0[j]+a1*c.y1[j];
+        z[j] = a0*c.z0[j]+a1*c.z1[j];
+        w[j] = a0*c.w0[j]+a1*c.w1[j];
+    }
+}
+
+typedef void (*ChunkKernel)(const Chunk &c, float *x, float *y, float *z, float *w);
+
+void Interpolate(const QuaternionArray &q0, const QuaternionArray &q1, const float *t, bool tArray,
+                 QuaternionArray &r, ChunkKernel kernel) {
+    // apply kernel to each chunk; t is a single parameter or (if tArray) Size parameters
+    size_t n = q0.Size();
+    r.Resize(n);
+    float tChunk[CHUNK], x[CHUNK], y[CHUNK], z[CHUNK], w[CHUNK];
+    if (!tArray)
+        for (int j = 0; j < CHUNK; j++)
+            tChunk[j] = *t;
+    for (size_t i = 0; i < r.Padded(); i += CHUNK) {
+        Chunk c = {q0.x.data()+i, q0.y.data()+i, q0.z.data()+i, q0.w.data()+i,
+                   q1.x.data()+i, q1.y.data()+i, q1.z.data()+i, q1.w.data()+i, tChunk};
+        if (tArray) {
+            if (n-i >= CHUNK)
+                c.t = t+i;
+            else {
+                // t is not padded
+                memset(tChunk, 0, sizeof(tChunk));
+                memcpy(tChunk, t+i, (n-i)*sizeof(float));
+            }
+        }
+        kernel(c, x, y, z, w);
+        memcpy(r.x.data()+i, x, sizeof(x));
+        memcpy(r.y.data()+i, y, sizeof(y));
+        memcpy(r.z.data()+i, z, sizeof(z));
+        memcpy(r.w.data()+i, w, sizeof(w));
+    }
+}
+
+} // end namespace
+
+void Nlerp(const QuaternionArray &q0, const QuaternionArray &q1, float t, QuaternionArray &r) {
+    Interpolate(q0, q1, &t, false, r, NlerpChunk);
+}
+
+void Nlerp(const QuaternionArray &q0, const QuaternionArray &q1, const float *t, QuaternionArray &r) {
+    Interpolate(q0, q1, t, true, r, NlerpChunk);
+}
+
+void Slerp(const QuaternionArray &q0, const QuaternionArray &q1, float t, QuaternionArray &r) {
+    Interpolate(q0, q1, &t, false, r, SlerpChunk);
+}
+
+void Slerp(const QuaternionArray &q0, const QuaternionArray &q1, const float *t, QuaternionArray &r) {
+    Interpolate(q0, q1, t, true, r, SlerpChunk);
+}
+
+void Get3x3(const QuaternionArray &q, mat3 *m) {
+    // as Quaternion::Get3x3; a chunk is computed without branches, and the test for a
+    // zero quaternion made while copying to m (a conditional keeps the loop from vectorizing)
+    float e[9][CHUNK], norm[CHUNK];
+    for (size_t i = 0; i < q.Size(); i += CHUNK) {
+        const float *__restrict x = q.x.data()+i, *__restrict y = q.y.data()+i;
+        const float *__restrict z = q.z.data()+i, *__restrict w = q.w.data()+i;
+        for (int j = 0; j < CHUNK; j++) {
+            norm[j] = x[j]*x[j]+y[j]*y[j]+z[j]*z[j]+w[j]*w[j];
+            float s = 2/norm[j];
+            float xs = x[j]*s,  ys = y[j]*s,  zs = z[j]*s;
+            float wx = w[j]*xs, wy = w[j]*ys, wz = w[j]*zs;
+            float xx = x[j]*xs, xy = x[j]*ys, xz = x[j]*zs;
+            float yy = y[j]*ys, yz = y[j]*zs, zz = z[j]*zs;
+            e[0][j] = 1-(yy+zz); e[1][j] = xy+wz;     e[2][j] = xz-wy;
+            e[3][j] = xy-wz;     e[4][j] = 1-(xx+zz); e[5][j] = yz+wx;
+            e[6][j] = xz+wy;     e[7][j] = yz-wx;     e[8][j] = 1-(xx+yy);
+        }
+        size_t count = q.Size()-i < CHUNK? q.Size()-i : CHUNK;
+        for (size_t j = 0; j < count; j++) {
+            mat3 &r = m[i+j];
+            if (norm[j] < FLT_EPSILON)
+                r = mat3();
+            else
+                r = mat3(vec3(e[0][j], e[1][j], e[2][j]), vec3(e[3][j], e[4][j], e[5][j]), vec3(e[6][j], e[7][j], e[8][j]));
+        }
+    }
+}
+
 /*
 Quaternion Quaternion::Mul(Quaternion &q1, Quaternion &q2) {
     float x =  q1.x * q2.w + q1.y * q2.z - q1.z * q2.y + q1.w * q2.x;
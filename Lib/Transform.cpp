@@ -0,0 +1,156 @@
+// Transform.cpp - transform arrays of points and normals
+
+#include "Transform.h"
+#include <math.h>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int BLOCK = 256;                  // points per de-interleaved block
+const size_t THREADMIN = 1 << 16;       // points per thread, at least
+
+template <class Kernel>
+void ForBlocks(size_t n, Kernel kernel) {
+    // call kernel(first, count) for each block of [0, n), split among threads if n is large
+    size_t nThreads = std::thread::hardware_concurrency();
+    if (nThreads > n/THREADMIN)
+        nThreads = n/THREADMIN;
+    if (nThreads < 1)
+        nThreads = 1;
+    size_t nBlocks = (n+BLOCK-1)/BLOCK, perThread = (nBlocks+nThreads-1)/nThreads;
+    auto Range = [&](size_t t) {
+        for (size_t b = t*perThread; b < (t+1)*perThread && b < nBlocks; b++) {
+            size_t first = b*BLOCK;
+            kernel(first, (int) (n-first < BLOCK? n-first : BLOCK));
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < nThreads; t++)
+        threads.push_back(std::thread(Range, t));
+    Range(0);
+    for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+}
+
+struct Block {
+    // x, y, z of up to BLOCK points; unused entries are zero, so that arithmetic
+    // loops can run over the whole block (a constant count, which compilers vectorize)
+    float x[BLOCK], y[BLOCK], z[BLOCK];
+    void Load(const vec3 *p, int count) {
+        const float *f = &p->x;
+        int i = 0;
+#ifdef VECMAT_SSE
+        for (; i+4 <= count; i += 4, f += 12) {
+            // a = x0 y0 z0 x1, b = y1 z1 x2 y2, c = z2 x3 y3 z3
+            __m128 a = _mm_loadu_ps(f), b = _mm_loadu_ps(f+4), c = _mm_loadu_ps(f+8);
+            __m128 t = _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2));
+            _mm_storeu_ps(x+i, _mm_shuffle_ps(a, t, _MM_SHUFFLE(2, 0, 3, 0)));
+            __m128 t1 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), t2 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3));
+            _mm_storeu_ps(y+i, _mm_shuffle_ps(t1, t2, _MM_SHUFFLE(2, 0, 2, 0)));
+            __m128 t3 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), t4 = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0));
+            _mm_storeu_ps(z+i, _mm_shuffle_ps(t3, t4, _MM_SHUFFLE(2, 0, 2, 0)));
+        }
+#endif
+        for (; i < count; i++, f += 3) {
+            x[i] = f[0];
+            y[i] = f[1];
+            z[i] = f[2];
+        }
+        for (; i < BLOCK; i++)
+            x[i] = y[i] = z[i] = 0;
+    }
+    void Store(vec3 *p, int count) const {
+        float *f = &p->x;
+        int i = 0;
+#ifdef VECMAT_SSE
+        for (; i+4 <= count; i += 4, f += 12) {
+            __m128 vx = _mm_loadu_ps(x+i), vy = _mm_loadu_ps(y+i), vz = _mm_loadu_ps(z+i);
+            __m128 a = _mm_shuffle_ps(_mm_shuffle_ps(vx, vy, _MM_SHUFFLE(0, 0, 0, 0)), _mm_shuffle_ps(vz, vx, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+            __m128 b = _mm_shuffle_ps(_mm_shuffle_ps(vy, vz, _MM_SHUFFLE(1, 1, 1, 1)), _mm_shuffle_ps(vx, vy, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0));
+            __m128 c = _mm_shuffle_ps(_mm_shuffle_ps(vz, vx, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(vy, vz, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+            _mm_storeu_ps(f, a);
+            _mm_storeu_ps(f+4, b);
+            _mm_storeu_ps(f+8, c);
+        }
+#endif
+        for (; i < count; i++, f += 3) {
+            f[0] = x[i];
+            f[1] = y[i];
+            f[2] = z[i];
+        }
+    }
+};
+
+} // end namespace
+
+void TransformPoints(const mat4 &m, const vec3 *in, vec3 *out, size_t n) {
+    const float m00 = m[0][0], m01 = m[0][1], m02 = m[0][2], m03 = m[0][3];
+    const float m10 = m[1][0], m11 = m[1][1], m12 = m[1][2], m13 = m[1][3];
+    const float m20 = m[2][0], m21 = m[2][1], m22 = m[2][2], m23 = m[2][3];
+    ForBlocks(n, [&](size_t first, int count) {
+        Block b, r;
+        b.Load(in+first, count);
+        for (int i = 0; i < BLOCK; i++) {
+            float x = b.x[i], y = b.y[i], z = b.z[i];
+            r.x[i] = m00*x+m01*y+m02*z+m03;
+            r.y[i] = m10*x+m11*y+m12*z+m13;
+            r.z[i] = m20*x+m21*y+m22*z+m23;
+        }
+        r.Store(out+first, count);
+    });
+}
+
+void TransformNormals(const mat4 &m, const vec3 *in, vec3 *out, size_t n, bool unitize) {
+    const float m00 = m[0][0], m01 = m[0][1], m02 = m[0][2];
+    const float m10 = m[1][0], m11 = m[1][1], m12 = m[1][2];
+    const float m20 = m[2][0], m21 = m[2][1], m22 = m[2][2];
+    ForBlocks(n, [&](size_t first, int count) {
+        Block b, r;
+        b.Load(in+first, count);
+        for (int i = 0; i < BLOCK; i++) {
+            float x = b.x[i], y = b.y[i], z = b.z[i];
+            r.x[i] = m00*x+m01*y+m02*z;
+            r.y[i] = m10*x+m11*y+m12*z;
+            r.z[i] = m20*x+m21*y+m22*z;
+        }
+        if (unitize)
+            for (int i = 0; i < BLOCK; i++) {
+                float d = r.x[i]*r.x[i]+r.y[i]*r.y[i]+r.z[i]*r.z[i];
+                float s = d > 0? 1.f/sqrtf(d) : 0;
+                r.x[i] *= s;
+                r.y[i] *= s;
+                r.z[i] *= s;
+            }
+        r.Store(out+first, count);
+    });
+}
+
+void ProjectToScreen(const mat4 &m, const int *viewport, const vec3 *in, vec2 *out, size_t n, float *zscreen) {
+    const float m00 = m[0][0], m01 = m[0][1], m02 = m[0][2], m03 = m[0][3];
+    const float m10 = m[1][0], m11 = m[1][1], m12 = m[1][2], m13 = m[1][3];
+    const float m20 = m[2][0], m21 = m[2][1], m22 = m[2][2], m23 = m[2][3];
+    const float m30 = m[3][0], m31 = m[3][1], m32 = m[3][2], m33 = m[3][3];
+    // pixel = viewport origin + (clip+1)*half viewport size
+    const float hw = .5f*(float) viewport[2], hh = .5f*(float) viewport[3];
+    const float cx = (float) viewport[0]+hw, cy = (float) viewport[1]+hh;
+    ForBlocks(n, [&](size_t first, int count) {
+        Block b;
+        float sx[BLOCK], sy[BLOCK];
+        b.Load(in+first, count);
+        for (int i = 0; i < BLOCK; i++) {
+            float x = b.x[i], y = b.y[i], z = b.z[i];
+            float w = m30*x+m31*y+m32*z+m33;
+            sx[i] = cx+hw*(m00*x+m01*y+m02*z+m03)/w;
+            sy[i] = cy+hh*(m10*x+m11*y+m12*z+m13)/w;
+        }
+        float *f = &out[first].x;
+        for (int i = 0; i < count; i++) {
+            f[2*i] = sx[i];
+            f[2*i+1] = sy[i];
+        }
+        if (zscreen)
+            for (int i = 0; i < count; i++)
+                zscreen[first+i] = m20*b.x[i]+m21*b.y[i]+m22*b.z[i]+m23;
+    });
+}
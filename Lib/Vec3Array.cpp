@@ -0,0 +1,257 @@
+// Vec3Array.cpp - 3D vectors stored as separate x, y, and z streams
+
+#include "Vec3Array.h"
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _MSC_VER
+    #include <malloc.h>
+#endif
+
+namespace {
+
+const size_t ALIGN = 64;                // bytes
+const int CHUNK = 16;                   // floats per 64 bytes; streams are padded to this
+
+float *AlignedAlloc(size_t nFloats) {
+    void *p = NULL;
+#ifdef _MSC_VER
+    p = _aligned_malloc(nFloats*sizeof(float), ALIGN);
+#else
+    if (posix_memalign(&p, ALIGN, nFloats*sizeof(float)) != 0)
+        p = NULL;
+#endif
+    if (!p)
+        throw("can't allocate memory");
+    return (float *) p;
+}
+
+void AlignedFree(float *p) {
+#ifdef _MSC_VER
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+} // end namespace
+
+// Vec3Array
+
+Vec3Array::Vec3Array(const Vec3Array &a) { *this = a; }
+
+Vec3Array &Vec3Array::operator = (const Vec3Array &a) {
+    if (this != &a) {
+        Resize(a.size);
+        if (padded)
+            memcpy(data, a.data, 3*padded*sizeof(float));
+    }
+    return *this;
+}
+
+Vec3Array::~Vec3Array() { AlignedFree(data); }
+
+void Vec3Array::Resize(size_t n) {
+    size_t p = (n+CHUNK-1)/CHUNK*CHUNK;
+    if (p != padded) {
+        float *d = p? AlignedAlloc(3*p) : NULL;
+        if (p)
+            memset(d, 0, 3*p*sizeof(float));
+        size_t keep = n < size? n : size;
+        for (int s = 0; s < 3 && keep; s++)
+            memcpy(d+s*p, data+s*padded, keep*sizeof(float));
+        AlignedFree(data);
+        data = d;
+        padded = p;
+    }
+    else
+        for (size_t i = n; i < size; i++)
+            x[i] = y[i] = z[i] = 0;
+    size = n;
+    x = data;
+    y = data? data+padded : NULL;
+    z = data? data+2*padded : NULL;
+}
+
+void Vec3Array::Load(const vec3 *v, size_t n) {
+    Resize(n);
+    for (size_t i = 0; i < n; i++) {
+        x[i] = v[i].x;
+        y[i] = v[i].y;
+        z[i] = v[i].z;
+    }
+}
+
+void Vec3Array::Store(vec3 *v) const {
+    for (size_t i = 0; i < size; i++)
+        v[i] = vec3(x[i], y[i], z[i]);
+}
+
+void Vec3Array::ClearPadding() {
+    for (size_t i = size; i < padded; i++)
+        x[i] = y[i] = z[i] = 0;
+}
+
+// Kernels
+
+// each loop runs over CHUNK-float pieces of the streams; the constant inner count and
+// the restrict-qualified per-chunk pointers let compilers vectorize without alias checks; where
+// the result may be an argument, a chunk is computed into a buffer, then copied
+
+void Add(const Vec3Array &a, const Vec3Array &b, Vec3Array &r) {
+    r.Resize(a.Size());
+    float cx[CHUNK], cy[CHUNK], cz[CHUNK];
+    for (size_t i = 0; i < a.Padded(); i += CHUNK) {
+        const float *__restrict ax = a.x+i, *__restrict ay = a.y+i, *__restrict az = a.z+i;
+        const float *__restrict bx = b.x+i, *__restrict by = b.y+i, *__restrict bz = b.z+i;
+        for (int j = 0; j < CHUNK; j++) {
+            cx[j] = ax[j]+bx[j];
+            cy[j] = ay[j]+by[j];
+            cz[j] = az[j]+bz[j];
+        }
+        memcpy(r.x+i, cx, sizeof(cx));
+        memcpy(r.y+i, cy, sizeof(cy));
+        memcpy(r.z+i, cz, sizeof(cz));
+    }
+}
+
+void Subtract(const Vec3Array &a, const Vec3Array &b, Vec3Array &r) {
+    r.Resize(a.Size());
+    float cx[CHUNK], cy[CHUNK], cz[CHUNK];
+    for (size_t i = 0; i < a.Padded(); i += CHUNK) {
+        const float *__restrict ax = a.x+i, *__restrict ay = a.y+i, *__restrict az = a.z+i;
+        const float *__restrict bx = b.x+i, *__restrict by = b.y+i, *__restrict bz = b.z+i;
+        for (int j = 0; j < CHUNK; j++) {
+            cx[j] = ax[j]-bx[j];
+            cy[j] = ay[j]-by[j];
+            cz[j] = az[j]-bz[j];
+        }
+        memcpy(r.x+i, cx, sizeof(cx));
+        memcpy(r.y+i, cy, sizeof(cy));
+        memcpy(r.z+i, cz, sizeof(cz));
+    }
+}
+
+void Scale(Vec3Array &a, float s) {
+    float cx[CHUNK], cy[CHUNK], cz[CHUNK];
+    for (size_t i = 0; i < a.Padded(); i += CHUNK) {
+        const float *__restrict ax = a.x+i, *__restrict ay = a.y+i, *__restrict az = a.z+i;
+        for (int j = 0; j < CHUNK; j++) {
+            cx[j] = ax[j]*s;
+            cy[j] = ay[j]*s;
+            cz[j] = az[j]*s;
+        }
+        memcpy(a.x+i, cx, sizeof(cx));
+        memcpy(a.y+i, cy, sizeof(cy));
+        memcpy(a.z+i, cz, sizeof(cz));
+    }
+}
+
+void Dot(const Vec3Array &a, const Vec3Array &b, float *r) {
+    float d[CHUNK];
+    for (size_t i = 0; i < a.Padded(); i += CHUNK) {
+        const float *__restrict ax = a.x+i, *__restrict ay = a.y+i, *__restrict az = a.z+i;
+        const float *__restrict bx = b.x+i, *__restrict by = b.y+i, *__restrict bz = b.z+i;
+        for (int j = 0; j < CHUNK; j++)
+            d[j] = ax[j]*bx[j]+ay[j]*by[j]+az[j]*bz[j];
+        memcpy(r+i, d, sizeof(d));
+    }
+}
+
+void Cross(const Vec3Array &a, const Vec3Array &b, Vec3Array &r) {
+    r.Resize(a.Size());
+    float cx[CHUNK], cy[CHUNK], cz[CHUNK];
+    for (size_t i = 0; i < a.Padded(); i += CHUNK) {
+        const float *__restrict ax = a.x+i, *__restrict ay = a.y+i, *__restrict az = a.z+i;
+        const float *__restrict bx = b.x+i, *__restrict by = b.y+i, *__restrict bz = b.z+i;
+        for (int j = 0; j < CHUNK; j++) {
+            cx[j] = ay[j]*bz[j]-az[j]*by[j];
+            cy[j] = az[j]*bx[j]-ax[j]*bz[j];
+            cz[j] = ax[j]*by[j]-ay[j]*bx[j];
+        }
+        memcpy(r.x+i, cx, sizeof(cx));
+        memcpy(r.y+i, cy, sizeof(cy));
+        memcpy(r.z+i, cz, sizeof(cz));
+    }
+}
+
+void Normalize(Vec3Array &a) {
+    float *x = a.x, *y = a.y, *z = a.z;
+#ifdef VECMAT_SSE
+    // sqrtf may set errno, which keeps compilers from vectorizing it
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1);
+    for (size_t i = 0; i < a.Padded(); i += 4) {
+        __m128 vx = _mm_load_ps(x+i), vy = _mm_load_ps(y+i), vz = _mm_load_ps(z+i);
+        __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+        __m128 s = _mm_and_ps(_mm_cmpgt_ps(d, zero), _mm_div_ps(one, _mm_sqrt_ps(d)));
+        _mm_store_ps(x+i, _mm_mul_ps(vx, s));
+        _mm_store_ps(y+i, _mm_mul_ps(vy, s));
+        _mm_store_ps(z+i, _mm_mul_ps(vz, s));
+    }
+#else
+    for (size_t i = 0; i < a.Padded(); i++) {
+        float d = x[i]*x[i]+y[i]*y[i]+z[i]*z[i];
+        float s = d > 0? 1.f/sqrtf(d) : 0;
+        x[i] *= s;
+        y[i] *= s;
+        z[i] *= s;
+    }
+#endif
+}
+
+void MinMax(const Vec3Array &a, vec3 &min, vec3 &max) {
+    // per-lane bounds over whole chunks, then the partial chunk, then across lanes
+    float lo[3][CHUNK], hi[3][CHUNK];
+    for (int k = 0; k < 3; k++)
+        for (int j = 0; j < CHUNK; j++) {
+            lo[k][j] = FLT_MAX;
+            hi[k][j] = -FLT_MAX;
+        }
+    const float *streams[] = {a.x, a.y, a.z};
+    size_t whole = a.Size()/CHUNK*CHUNK;
+    for (int k = 0; k < 3; k++) {
+        const float *__restrict s = streams[k];
+        float *__restrict l = lo[k], *__restrict h = hi[k];
+        for (size_t i = 0; i < whole; i += CHUNK) {
+            const float *__restrict c = s+i;
+            for (int j = 0; j < CHUNK; j++) {
+                l[j] = c[j] < l[j]? c[j] : l[j];
+                h[j] = c[j] > h[j]? c[j] : h[j];
+            }
+        }
+        for (size_t i = whole; i < a.Size(); i++) {
+            int j = (int) (i-whole);
+            l[j] = s[i] < l[j]? s[i] : l[j];
+            h[j] = s[i] > h[j]? s[i] : h[j];
+        }
+    }
+    min = vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+    max = vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (int k = 0; k < 3; k++)
+        for (int j = 0; j < CHUNK; j++) {
+            if (lo[k][j] < min[k]) min[k] = lo[k][j];
+            if (hi[k][j] > max[k]) max[k] = hi[k][j];
+        }
+}
+
+void TransformPoints(const mat4 &m, const Vec3Array &in, Vec3Array &out) {
+    out.Resize(in.Size());
+    const float m00 = m[0][0], m01 = m[0][1], m02 = m[0][2], m03 = m[0][3];
+    const float m10 = m[1][0], m11 = m[1][1], m12 = m[1][2], m13 = m[1][3];
+    const float m20 = m[2][0], m21 = m[2][1], m22 = m[2][2], m23 = m[2][3];
+    float cx[CHUNK], cy[CHUNK], cz[CHUNK];
+    for (size_t i = 0; i < in.Padded(); i += CHUNK) {
+        const float *__restrict ix = in.x+i, *__restrict iy = in.y+i, *__restrict iz = in.z+i;
+        for (int j = 0; j < CHUNK; j++) {
+            float x = ix[j], y = iy[j], z = iz[j];
+            cx[j] = m00*x+m01*y+m02*z+m03;
+            cy[j] = m10*x+m11*y+m12*z+m13;
+            cz[j] = m20*x+m21*y+m22*z+m23;
+        }
+        memcpy(out.x+i, cx, sizeof(cx));
+        memcpy(out.y+i, cy, sizeof(cy));
+        memcpy(out.z+i, cz, sizeof(cz));
+    }
+    out.ClearPadding();     // padding was transformed to the translation
+}
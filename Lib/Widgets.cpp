@@ -220,6 +220,7 @@ void SetPlane(vec3 p, int x, int y, mat4 modelview, mat4 persp, float *plane) {
 }
 
 void Mover::Down(vec3 *p, int x, int y, mat4 modelview, mat4 persp) {
+    glGetIntegerv(GL_VIEWPORT, viewport);   // kept for Drag, which then needs no GL query
     vec2 s = ScreenPoint(*p, persp*modelview);
     mouseOffset = vec2(s.x-x, s.y-y);
     point = p;
@@ -231,7 +232,7 @@ void Mover::Drag(int xMouse, int yMouse, mat4 modelview, mat4 persp) {
         return;
     vec3 p1, p2, axis;
     float x = xMouse+mouseOffset.x, y = yMouse+mouseOffset.y;
-    ScreenLine((float) x, (float) y, modelview, persp, p1, p2);
+    ScreenLine((float) x, (float) y, modelview, persp, p1, p2, viewport);
     // get two points that transform to pixel x,y
     axis = p2-p1;
     // direction of line through p1
@@ -282,6 +283,7 @@ bool Joystick::Hit(int x, int y, mat4 fullview) {
 
 void Joystick::Down(int x, int y, vec3 *b, vec3 *v, mat4 modelview, mat4 persp) {
     mat4 fullview = persp*modelview;
+    glGetIntegerv(GL_VIEWPORT, viewport);   // kept for Drag
     base = b;
     vec = v;
     fwdFace = FrontFacing(*base, *vec, fullview);
@@ -293,7 +295,7 @@ void Joystick::Down(int x, int y, vec3 *b, vec3 *v, mat4 modelview, mat4 persp)
 
 void Joystick::Drag(int x, int y, mat4 modelview, mat4 persp) {
     vec3 p1, p2;                                        // p1p2 is world-space line that xforms to line perp to screen at (x, y)
-    ScreenLine((float) x, (float) y, modelview, persp, p1, p2);
+    ScreenLine((float) x, (float) y, modelview, persp, p1, p2, viewport);
     if (mode == JoyType::A_Base) {
         vec3 axis(p2-p1);                               // direction of line through p1
         vec3 normal(plane[0], plane[1], plane[2]);